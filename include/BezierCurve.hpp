@@ -21,41 +21,53 @@
 #include "Platform.hpp"
 #include "Maths.hpp"
 
+#include <algorithm>
+
 // Three-dimensional Bezier curve
 template <typename T>
 struct BezierCurve {
+   // Number of intervals in the arc length table and the number of
+   // chords used to measure each one
+   static const int ARC_SAMPLES = 64;
+   static const int ARC_STEPS = 16;
+
    Vector<T> p[4];
    T length;  // Approximate
 
+   // arc[i] is the length of the curve from t = 0 to t = i / ARC_SAMPLES
+   T arc[ARC_SAMPLES + 1];
+
    BezierCurve(Vector<T> p1, Vector<T> p2, Vector<T> p3, Vector<T> p4)
    {
       p[0] = p1;
       p[1] = p2;
       p[2] = p3;
       p[3] = p4;
-      
-      // Approximate the length
+
+      // Approximate the length by summing short chords
+      const int n = ARC_SAMPLES * ARC_STEPS;
       Vector<T> cur = operator()(0.0), prev;
 
+      arc[0] = 0.0;
       length = 0.0;
-            
-      const T step = static_cast<T>(0.0001);
-      const T max = static_cast<T>(1.0);
-      
-      for (T t = step; t <= max; t += step) {
+
+      for (int i = 1; i <= n; i++) {
          prev = cur;
-         cur = operator()(t);
+         cur = operator()(static_cast<T>(i) / n);
 
          const Vector<T> diff = cur - prev;
-         
+
          length += diff.length();
+
+         if (i % ARC_STEPS == 0)
+            arc[i / ARC_STEPS] = length;
       }
    }
 
    BezierCurve()
       : length(0)
    {
-
+      std::fill(arc, arc + ARC_SAMPLES + 1, static_cast<T>(0));
    }
 
    Vector<T> operator()(T t) const
@@ -81,32 +93,30 @@ struct BezierCurve {
           );
    }
 
-   // A slower approximation to the curve function that guarantees
-   // a linear relationship between s and the arc length
+   // An approximation to the curve function that guarantees a
+   // linear relationship between s and the arc length
    Vector<T> linear(T s, T *out = NULL) const
    {
-      Vector<T> cur = operator()(0.0), prev;
+      const T t = arc_parameter(length * s);
 
-      T now = static_cast<T>(0.0);
-      const T target = length * s;
-            
-      const T step = static_cast<T>(0.0001);
-      const T max = static_cast<T>(1.0);
+      if (out)
+         *out = t;
+      return operator()(t);
+   }
 
-      // TODO: could speed this up using a lookup table
-      T t;
-      for (t = step; t <= max && now < target; t += step) {
-         prev = cur;
-         cur = operator()(t);
+   // The value of t at which the curve has the given arc length
+   // Found by interpolating between entries in the arc length table
+   T arc_parameter(T distance) const
+   {
+      const T* end = arc + ARC_SAMPLES + 1;
+      const int i = std::lower_bound(arc + 1, end - 1, distance) - arc;
 
-         const Vector<T> diff = cur - prev;
-         now += diff.length();
-      }
+      const T span = arc[i] - arc[i - 1];
+      T frac = span > 0 ? (distance - arc[i - 1]) / span : 0;
+      frac = std::max(static_cast<T>(0.0),
+                      std::min(frac, static_cast<T>(1.0)));
 
-      if (out)
-         *out = std::max(static_cast<T>(0.0),
-                         std::min(t, static_cast<T>(1.0)));
-      return cur;
+      return (static_cast<T>(i - 1) + frac) / ARC_SAMPLES;
    }
 
    // The derivative with respect to t at a point
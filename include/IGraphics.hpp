@@ -35,6 +35,8 @@ struct IGraphics {
                            const Vector<float>& a_rotation) = 0;
    virtual void look_at(const Vector<float> an_eye_point,
                         const Vector<float> a_target_point) = 0;
+   virtual Vector<float> camera_position() const = 0;
+   virtual const Frustum& view_frustum() const = 0;
 };
 
 typedef shared_ptr<IGraphics> IGraphicsPtr;
@@ -28,6 +28,14 @@
 #include <memory>
 #include <string>
 
+// What lies under a ray cast into the map
+struct PickResult {
+   Point<int> tile;          // Tile containing the hit
+   Point<int> vertex;        // Closest height map vertex to the hit
+   Vector<float> position;   // Where the ray meets the terrain
+   ISceneryPtr scenery;      // Scenery covering the tile, if any
+};
+
 // A map is a MxN array of floating point height values
 // It also contains the track layout and any scenery items
 class IMap {
@@ -56,6 +64,19 @@ public:
    // Delete the contents of a tile
    virtual void erase_tile(int x, int y) = 0;
 
+   // Number of changes made to the track and stations so far
+   virtual unsigned track_generation() const = 0;
+
+   // Add the tiles whose track or station changed after the given
+   // generation so cached routes can be invalidated incrementally
+   virtual void track_changes(unsigned since, PointList& output) const = 0;
+
+   // Readers of track_changes hold the generation they have caught up
+   // to and release it when they move on; changes older than every
+   // held generation are discarded
+   virtual void hold_track_changes(unsigned generation) = 0;
+   virtual void release_track_changes(unsigned generation) = 0;
+
    // False if this tile has something in it (track, scenery, etc.)
    virtual bool empty_tile(Point<int> point) const = 0;
 
@@ -68,11 +89,9 @@ public:
    // Draw a coloured highlight over the given tile
    virtual void highlight_tile(Point<int> point, Colour colour) const = 0;
    
-   // Given a pick name return the (x, y) co-ordinate
-   virtual Point<int> pick_position(unsigned a_name) const = 0;
-
-   // True if this names a valid tile
-   virtual bool is_valid_tileName(unsigned a_name) const = 0;
+   // Find the first point where a ray hits the terrain
+   // Returns false if the ray misses the map entirely
+   virtual bool pick(const Ray& ray, PickResult& result) const = 0;
 
    // Save the map to its resource
    virtual void save() = 0;
@@ -88,11 +107,6 @@ public:
    // Toggle display of grid lines
    virtual void set_grid(bool on_off) = 0;
 
-   // Toggle pick mode on and off
-   // This turns of display of everything but the terrain
-   // and things that can be clicked on
-   virtual void set_pick_mode(bool on_off) = 0;
-
    // Make a hill or valley in the given area
    virtual void raise_area(const Point<int>& a_start_pos,
       const Point<int>& a_finish_pos) = 0;
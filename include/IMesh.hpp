@@ -52,6 +52,10 @@ struct IMeshBuffer {
 
    virtual void merge(shared_ptr<IMeshBuffer> other,
       Vector<float> off, float y_angle=0.0f) = 0;
+
+   // Write the buffer in a binary format for read_mesh_buffer
+   // Textures cannot be saved so every chunk must be untextured
+   virtual void write(ostream& os) const = 0;
 };
 
 typedef shared_ptr<IMeshBuffer> IMeshBufferPtr;
@@ -67,7 +71,13 @@ typedef shared_ptr<IMesh> IMeshPtr;
 
 IMeshPtr make_mesh(IMeshBufferPtr a_buffer);
 IMeshBufferPtr make_mesh_buffer();
+IMeshBufferPtr read_mesh_buffer(const char* data, size_t size);
 void update_render_stats();
 int get_average_triangle_count();
 
+// Bytes of vertex data held in VBOs and the amount saved over the
+// unpacked vertex format
+size_t get_vertex_memory_used();
+size_t get_vertex_memory_saved();
+
 #endif
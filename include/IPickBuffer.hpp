@@ -19,14 +19,15 @@
 #define INC_IPICKBUFFER_HPP
 
 #include "Platform.hpp"
-#include "IGraphics.hpp"
+#include "Maths.hpp"
 
-// Provides access to a pick buffer for selecting objects
+// Converts window co-ordinates into rays for selecting objects
 struct IPickBuffer {
    virtual ~IPickBuffer() {}
 
-   virtual IGraphicsPtr begin_pick(int x, int y) = 0;
-   virtual unsigned end_pick() = 0;
+   // The ray from the eye through window pixel (x, y) using the
+   // camera set for the last frame
+   virtual Ray pick_ray(int x, int y) const = 0;
 };
 
 typedef shared_ptr<IPickBuffer> IPickBufferPtr;
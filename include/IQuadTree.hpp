@@ -22,16 +22,32 @@
 #include "Maths.hpp"
 #include "IGraphics.hpp"
 
+// Edges of a sector
+enum SectorEdge {
+   EDGE_LEFT = 1, EDGE_RIGHT = 2, EDGE_BOTTOM = 4, EDGE_TOP = 8
+};
+
+// Terrain detail to render a sector at
+struct SectorLOD {
+   int level;          // Terrain quads are 2^level tiles across
+   unsigned coarser;   // Mask of edges which border a coarser sector
+};
+
 // Interface to things that can be rendered by sector
 struct ISectorRenderable {
    virtual ~ISectorRenderable() {}
 
    virtual void render_sector(IGraphicsPtr a_context, int id,
                               Point<int> bot_left,
-                              Point<int> top_right) = 0;
+                              Point<int> top_right,
+                              const SectorLOD& lod) = 0;
    virtual void post_render_sector(IGraphicsPtr a_context, int id,
                                    Point<int> bot_left,
                                    Point<int> top_right) = 0;
+
+   // Lowest and highest points of anything drawn in a sector
+   virtual void height_range(Point<int> bot_left, Point<int> top_right,
+                             float& low, float& high) const = 0;
 };
 
 typedef shared_ptr<ISectorRenderable> ISectorRenderablePtr;
@@ -42,6 +58,11 @@ struct IQuadTree {
 
    virtual void render(IGraphicsPtr a_context) = 0;
    virtual int leaf_size() const = 0;
+
+   // Recalculate the height bounds of every sector which shares
+   // vertices with this area
+   virtual void update_heights(Point<int> bot_left,
+                               Point<int> top_right) = 0;
 };
 
 typedef shared_ptr<IQuadTree> IQuadTreePtr;
@@ -22,6 +22,7 @@
 #include "IController.hpp"
 #include "Maths.hpp"
 #include "ICargo.hpp"
+#include "ISignalling.hpp"
 
 // Interface for various powered and unpowered parts of the train
 struct IRollingStock {
@@ -29,6 +30,11 @@ struct IRollingStock {
 
    // Update speed, fuel, etc.
    virtual void update(int delta, double gravity) = 0;
+
+   // Tell the vehicle about the next signal and how many metres away
+   // it is before the next update with the same pull of gravity
+   virtual void signal_ahead(SignalAspect aspect, double distance,
+                             double gravity) = 0;
    
    // Display the model
    virtual void render() const = 0;
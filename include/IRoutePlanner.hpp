@@ -0,0 +1,69 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef INC_IROUTE_PLANNER_HPP
+#define INC_IROUTE_PLANNER_HPP
+
+#include "Platform.hpp"
+#include "IMap.hpp"
+#include "ITrackGraph.hpp"
+
+// One arc of the track graph a route follows
+// Only the track connections are kept as the graph's node numbers
+// change whenever it is rebuilt while a cached route stays valid
+struct RouteStep {
+   track::Connection departure, arrival;
+   float length;
+};
+
+// A path through the track graph that a train can follow without
+// reversing
+struct Route {
+   float length;
+   vector<RouteStep> steps;   // In order of travel
+   PointList tiles;           // Sorted tiles under the route
+};
+
+// Finds the shortest routes between stations
+// Results are cached and only thrown away when a change to the
+// track could affect them
+struct IRoutePlanner {
+   virtual ~IRoutePlanner() {}
+
+   // Find the shortest route from one station to another leaving
+   // in either direction
+   // Only stations connected to the map's start position can be
+   // reached
+   // Returns false if there is no route
+   virtual bool find_route(IStationPtr from, IStationPtr to,
+                           Route& route) = 0;
+
+   // As above but for a train at the first station travelling in
+   // the given direction, which the route must leave by
+   virtual bool find_route(IStationPtr from, track::Direction direction,
+                           IStationPtr to, Route& route) = 0;
+
+   // Set the points along a route so a train will follow it
+   // While the game is running this must be called on the
+   // simulation thread
+   virtual void set_points(const Route& route) const = 0;
+};
+
+typedef shared_ptr<IRoutePlanner> IRoutePlannerPtr;
+
+IRoutePlannerPtr make_route_planner(IMapPtr map);
+
+#endif
@@ -23,6 +23,15 @@
 #include "IMesh.hpp"
 #include "IIndustry.hpp"
 
+// Enough to recreate a piece of scenery without the XML
+struct SceneryRef {
+   enum Kind { TREE, BUILDING };
+
+   Kind kind;
+   string name;   // Resource name
+   float angle;
+};
+
 // Static scenery such as trees
 struct IScenery : IXMLSerialisable {
    virtual ~IScenery() {}
@@ -34,6 +43,7 @@ struct IScenery : IXMLSerialisable {
    virtual const string& name() const = 0;
    virtual Point<int> size() const = 0;
    virtual IIndustryPtr industry() const = 0;
+   virtual SceneryRef reference() const = 0;
 };
 
 typedef shared_ptr<IScenery> ISceneryPtr;
@@ -41,9 +51,15 @@ typedef shared_ptr<IScenery> ISceneryPtr;
 class AttributeSet;
 
 ISceneryPtr load_tree(const string& name);
+ISceneryPtr load_tree(const string& name, float angle);
 ISceneryPtr load_tree(const AttributeSet& attrs);
 
 ISceneryPtr load_building(const string& a_res_id, float angle);
 ISceneryPtr load_building(const AttributeSet& attrs);
 
+// Start loading on a worker thread: true once the load functions
+// above will return without blocking
+bool prefetch_tree(const string& name);
+bool prefetch_building(const string& a_res_id);
+
 #endif
@@ -39,9 +39,13 @@ struct IScreen {
    // Draw the 2D part of the screen
    virtual void overlay() const = 0;
 
-   // Update the state of the game
-   // Delta delay is milliseconds since last frame
+   // Update the state of the game by one simulation tick
+   // Delta is the fixed length of a tick in milliseconds
    virtual void update(IPickBufferPtr a_pick_buffer, int a_delta) = 0;
+
+   // Called before each frame is drawn with the fraction of a tick
+   // that has passed since the last update
+   virtual void interpolate(float a_fraction) = 0;
    
    virtual void on_key_down(SDLKey a_key) = 0;
    virtual void on_key_up(SDLKey a_key) = 0;
@@ -0,0 +1,64 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef INC_ISIGNALLING_HPP
+#define INC_ISIGNALLING_HPP
+
+#include "Platform.hpp"
+#include "IMap.hpp"
+#include "ITrackSegment.hpp"
+
+// What a signal at the start of a block tells a train
+enum SignalAspect {
+   SIGNAL_CLEAR,
+   SIGNAL_DANGER    // Another train is in the block
+};
+
+// Splits the track into blocks and tracks which train is in each one
+// Points are blocks on their own, each station is a block and the
+// plain track between them forms the rest
+// Only the simulation thread should use this once trains are running
+struct ISignalling {
+   virtual ~ISignalling() {}
+
+   // Track not connected to the start position is in no block
+   static const int NO_BLOCK = -1;
+
+   virtual int block_count() const = 0;
+
+   // Block containing a track segment
+   virtual int block_of(const ITrackSegmentPtr& track) const = 0;
+
+   // The next block a train entering `track' with `token' will reach
+   // and the distance from the start of the segment to it
+   // Returns NO_BLOCK at the end of the line
+   virtual int block_ahead(const ITrackSegmentPtr& track,
+                           const track::TravelToken& token,
+                           float& distance) const = 0;
+
+   // Called as each part of a train moves between blocks
+   virtual void enter_block(int block, int train) = 0;
+   virtual void leave_block(int block, int train) = 0;
+
+   // The aspect of the signal protecting a block as seen by a train
+   virtual SignalAspect aspect(int block, int train) const = 0;
+};
+
+typedef shared_ptr<ISignalling> ISignallingPtr;
+
+ISignallingPtr make_signalling(IMapPtr map);
+
+#endif
@@ -0,0 +1,48 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INC_ISIMULATION_THREAD_HPP
+#define INC_ISIMULATION_THREAD_HPP
+
+#include "Platform.hpp"
+
+// Runs the game simulation at a fixed rate on its own thread so its
+// cost does not add to the frame time
+// Stops when the object is destroyed
+struct ISimulationThread {
+   virtual ~ISimulationThread() {}
+
+   // The argument is the length of a tick in milliseconds
+   typedef function<void (int)> TickFunc;
+   typedef function<void ()> Job;
+
+   // Run a job on the simulation thread before the next tick
+   virtual void post(Job job) = 0;
+
+   // Rethrow any exception that stopped the simulation
+   virtual void check_errors() = 0;
+};
+
+typedef shared_ptr<ISimulationThread> ISimulationThreadPtr;
+
+ISimulationThreadPtr make_simulation_thread(ISimulationThread::TickFunc tick);
+
+// Length of a simulation tick in milliseconds set by the TickRate
+// config option, which must divide 1000
+int simulation_tick_ms();
+
+#endif
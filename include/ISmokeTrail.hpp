@@ -19,16 +19,34 @@
 #define INC_ISMOKE_TRAIL_HPP
 
 #include "Platform.hpp"
+#include "Maths.hpp"
+#include "Colour.hpp"
+
+#include <vector>
+
+// What the renderer needs to know about a smoke particle
+struct SmokeParticle {
+   Vector<float> position;
+   float scale;
+   Colour colour;
+};
+
+typedef vector<SmokeParticle> SmokeParticleList;
 
 // Smoke and steam effects
+// The particles are updated and drawn separately so the simulation can
+// run on a different thread to the renderer
 struct ISmokeTrail {
    virtual ~ISmokeTrail() {}
 
    // Move and generate new particles
    virtual void update(int a_delta) = 0;
-   
-   // Draw all the particles
-   virtual void render() const = 0;
+
+   // Copy the state of the live particles
+   virtual void get_particles(SmokeParticleList& a_list) const = 0;
+
+   // Draw particles previously returned by get_particles
+   virtual void render(const SmokeParticleList& a_list) const = 0;
 
    // Change the position where new particles are generated
    virtual void set_position(float x, float y, float z) = 0;
@@ -0,0 +1,43 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INC_ITHREAD_POOL_HPP
+#define INC_ITHREAD_POOL_HPP
+
+#include "Platform.hpp"
+
+// A set of worker threads which run jobs in the background
+// Jobs must not make any OpenGL calls
+struct IThreadPool {
+   virtual ~IThreadPool() {}
+
+   typedef function<void ()> Job;
+
+   // Queue a job to run on the next free worker
+   virtual void submit(Job job) = 0;
+
+   virtual int thread_count() const = 0;
+};
+
+typedef shared_ptr<IThreadPool> IThreadPoolPtr;
+
+IThreadPoolPtr make_thread_pool(int threads);
+
+// Shared pool with one worker per spare processor
+IThreadPoolPtr get_thread_pool();
+
+#endif
@@ -20,26 +20,39 @@
 
 #include "IMap.hpp"
 
+// A compact summary of the track layout where each node is somewhere
+// a train can make a decision or must stop and each arc is the
+// stretch of track between two nodes
 namespace graph {
 
    struct Arc;
 
    enum NodeType {
-      NODE_ROOT,
+      NODE_ROOT,       // The map's start position
       NODE_STATION,
-      NODE_POINTS
+      NODE_POINTS,
+      NODE_DEAD_END
    };
    
    struct Node {
       unsigned id;
       NodeType type;
-      vector<Arc> arcs;
-      ITrackSegmentPtr track;
+      vector<Arc> arcs;          // Arcs leaving this node
+      ITrackSegmentPtr track;    // Null for dead ends
+      IStationPtr station;       // Only for station nodes
    };
 
+   // Every stretch of track has an arc in each direction
    struct Arc {
       unsigned start, end;
-      float length;
+      float length;   // Including the track of the end node
+
+      // Where the train leaves the start node and how it enters the
+      // track of the end node
+      track::Connection departure, arrival;
+
+      float rise;           // Change in height from start to end
+      float max_gradient;   // Steepest slope in either direction
    };
 }
 
@@ -49,7 +62,8 @@ struct ITrackGraph {
    virtual void write_dot_file(const string& file) const = 0;
    
    virtual const graph::Node& root() const = 0;
-   virtual const graph::Node& node(unsigned n) const = 0;   
+   virtual const graph::Node& node(unsigned n) const = 0;
+   virtual unsigned node_count() const = 0;
 };
 
 typedef shared_ptr<ITrackGraph> ITrackGraphPtr;
@@ -20,12 +20,15 @@
 
 #include "Platform.hpp"
 #include "Maths.hpp"
+#include "Matrix.hpp"
 #include "IXMLSerialisable.hpp"
 #include "IMesh.hpp"
 
 #include <vector>
 #include <set>
 
+#include <boost/cstdint.hpp>
+
 // Types used for specifying track segments
 namespace track {
    // TODO: This only needs (x, y) position and should contain
@@ -42,7 +45,7 @@ namespace track {
    typedef int Angle;
 
    struct TravelToken;
-   typedef function<void (const TravelToken&, double)> TransformFunc;
+   typedef function<MatrixF4 (const TravelToken&, float)> TransformFunc;
    typedef function<float (const TravelToken&, float)> GradientFunc;
 
    float flat_gradient_func(const TravelToken& t, float d);
@@ -56,9 +59,10 @@ namespace track {
       // Position of entry
       Position position;
 
-      // A function that transforms the location of the train so it will
-      // render in the correct place for this track segment The functions
-      // assumes that it is initially placed at the origin
+      // A function that returns the transformation from a train at the
+      // origin to its location and orientation on this track segment
+      // This is computed entirely on the CPU and so is safe to call
+      // without an OpenGL context
       TransformFunc transformer;
 
       // A function that returns the gradient at any point
@@ -70,9 +74,9 @@ namespace track {
 
       // Wrappers for the above functions
 
-      void transform(float delta) const
+      MatrixF4 transform(float delta) const
       {
-         transformer(*this, delta);
+         return transformer(*this, delta);
       }
 
       float gradient(float delta) const
@@ -80,6 +84,15 @@ namespace track {
          return gradientf(*this, delta);
       }
    };
+
+   // Everything needed to rebuild a segment when loading a compiled
+   // map with the meaning of the parameters depending on the type
+   struct Record {
+      enum Type { STRAIGHT, SLOPE, POINTS, CROSSOVER, SPLINE };
+
+      int32_t type;
+      int32_t params[6];
+   };
 }
 
 // Orientations for straight track
@@ -128,6 +141,11 @@ struct ITrackSegment : IXMLSerialisable {
    virtual track::Connection next_position(const track::TravelToken& a_token)
       const = 0;
 
+   // Add every connection that `next_position' could return for this
+   // token whatever the state of the track
+   virtual void get_exits(const track::TravelToken& a_token,
+                          vector<track::Connection>& output) const = 0;
+
    // Add all the endpoints of the track segment to the given list
    // Note that an endpoint is not the same as what is returned
    // from `next_position' - e.g. a straight track that takes up
@@ -160,6 +178,9 @@ struct ITrackSegment : IXMLSerialisable {
    // Set a hint to display something about the track state on the next render
    // call - e.g display an arrow over points
    virtual void set_state_render_hint() = 0;
+
+   // Compact alternative to to_xml for compiled maps
+   virtual track::Record record() const = 0;
 };
 
 ITrackSegmentPtr make_straight_track(const track::Direction& a_direction);
@@ -23,16 +23,20 @@
 #include "IMap.hpp"
 #include "ITrackSegment.hpp"
 
-// Interface to managing complete trains
+// Interface to a single train in an ITrainStore
+// These read the snapshot the store publishes at the end of each
+// update so may be called from the render thread while the
+// simulation runs
 struct ITrain {
    virtual ~ITrain() {}
 
-   virtual void render() const = 0;
-   virtual void update(int a_delta) = 0;
+   // Draw the train a_fraction of the way between its state after
+   // the previous update and its current state
+   virtual void render(float a_fraction) const = 0;
 
    // Return a vector of the absolute position of the front of
-   // the train
-   virtual VectorF front() const = 0;
+   // the train interpolated in the same way as render
+   virtual VectorF front(float a_fraction) const = 0;
 
    // Return the track segment occupied by the front of the train
    virtual ITrackSegmentPtr track_segment() const = 0;
@@ -46,12 +50,45 @@ struct ITrain {
    // Return the track direction of the front of the train
    virtual track::Direction direction() const = 0;
 
+   // Return the signal protecting the next block on the line
+   virtual SignalAspect signal_aspect() const = 0;
+
    // Return the controller for whatever's driving this train
+   // Actions are queued until the next update
    virtual IControllerPtr controller() = 0;
 };
 
 typedef shared_ptr<ITrain> ITrainPtr;
 
-ITrainPtr make_train(IMapPtr a_map);
+// All the trains running on a map
+// Only update runs on the simulation thread
+struct ITrainStore {
+   virtual ~ITrainStore() {}
+
+   // Put a new train a_offset along the line from the start location
+   // This must not be called while the simulation is running
+   virtual ITrainPtr add_train(float a_offset) = 0;
+
+   virtual int train_count() const = 0;
+   virtual ITrainPtr train(int i) const = 0;
+
+   // Advance every train by a_delta milliseconds
+   virtual void update(int a_delta) = 0;
+
+   // Switch to the latest snapshot published by update
+   // This should be called once per frame before rendering
+   virtual void sync() = 0;
+
+   // Fraction of a tick that has passed since the snapshot chosen by
+   // the last sync was published
+   virtual float tick_fraction() const = 0;
+
+   // Draw all the trains as ITrain::render
+   virtual void render(float a_fraction) const = 0;
+};
+
+typedef shared_ptr<ITrainStore> ITrainStorePtr;
+
+ITrainStorePtr make_train_store(IMapPtr a_map);
 
 #endif
@@ -0,0 +1,52 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INC_MAPPED_FILE_HPP
+#define INC_MAPPED_FILE_HPP
+
+#include "Platform.hpp"
+
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file which is memory mapped where the
+// platform supports it and read into a buffer otherwise
+class MappedFile {
+public:
+   explicit MappedFile(const string& file_name);
+   ~MappedFile();
+
+   const char* data() const { return data_; }
+   size_t size() const { return size_; }
+   const string& file_name() const { return file_name_; }
+
+private:
+   // Not copyable as the destructor unmaps the file
+   MappedFile(const MappedFile&);
+   MappedFile& operator=(const MappedFile&);
+
+   const string file_name_;
+   const char* data_;
+   size_t size_;
+#ifdef WIN32
+   vector<char> buffer;
+#endif
+};
+
+typedef shared_ptr<MappedFile> MappedFilePtr;
+
+#endif
@@ -342,17 +342,40 @@ typedef Point<float> PointF;
 
 // A frustum
 struct Frustum {
+   enum Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+   static const unsigned ALL_PLANES = 0x3f;
+
    bool point_in_frustum(float x, float y, float z);
    bool sphere_in_frustum(float x, float y, float z, float radius);
    bool cube_in_frustum(float x, float y, float z, float size);	// size = 0.5*side_length
    bool cuboid_in_frustum(float x,	  float y,	   float z,
       float sizeX, float sizeY, float sizeZ);
 
+   // Test an axis-aligned box against the planes set in `mask'. Bits
+   // are cleared for planes the box is entirely inside so anything
+   // contained in the box can skip them
+   Containment box_in_frustum(const Vector<float>& lo,
+                              const Vector<float>& hi,
+                              unsigned& mask) const;
+
+   // Test an array of boxes against the planes in `plane_mask' four at
+   // a time. Bit i % 32 of visible[i / 32] is set if box i is at least
+   // partly inside the frustum
+   void boxes_in_frustum(const Vector<float>* lo, const Vector<float>* hi,
+                         size_t count, unsigned* visible,
+                         unsigned plane_mask = ALL_PLANES) const;
+
    float planes[6][4];
 };
 
 Frustum get_view_frustum();
 
+// A half-line starting at `origin' pointing along `direction'
+struct Ray {
+   Vector<float> origin, direction;
+};
+
 // A rough guess at the gradient at a point on a curve
 float approx_gradient(function<float (float)> a_func, float x);
 
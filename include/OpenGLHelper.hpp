@@ -23,6 +23,7 @@
 #include "IGraphics.hpp"
 #include "IPickBuffer.hpp"
 #include "Colour.hpp"
+#include "Matrix.hpp"
 
 #include <GL/gl.h>
 
@@ -33,10 +34,6 @@ void resizeGLScene(IWindowPtr a_window);
 void printGLVersion();
 void checkGLError();
 
-// Wrappers for OpenGL picking features
-void begin_pick(IWindowPtr a_window, unsigned* a_buffer, int x, int y);
-unsigned end_pick(unsigned* a_buffer);
-
 // Helper functions for using our Vector and Colour objects
 // as OpenGL types
 namespace gl {
@@ -55,6 +52,17 @@ namespace gl {
       glTranslatef(v.x, v.y, v.z);
    }
 
+   // Our matrices are row major but OpenGL expects column major
+   inline void mult_matrix(const MatrixF4& m)
+   {
+      float cols[16];
+      for (int i = 0; i < 4; i++) {
+         for (int j = 0; j < 4; j++)
+            cols[j*4 + i] = m.entries[i][j];
+      }
+      glMultMatrixf(cols);
+   }
+
    template <class T>
    inline void vertex(const Vector<T>& v);
 
@@ -20,15 +20,23 @@
 
 #include <string>
 #include <map>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
 
 #include "IResource.hpp"
+#include "IThreadPool.hpp"
 
 // A generic cache for resources
+// Resources may be loaded on a worker thread with load_async in which
+// case the loader must not make any OpenGL calls
 template <class T>
 class ResourceCache {
 public:
    typedef function<T* (IResourcePtr)> LoaderType;
-   
+   typedef shared_future<shared_ptr<T> > Future;
+
    ResourceCache(LoaderType a_loader, const string& a_class)
       : my_loader(a_loader), my_class(a_class) {}
 
@@ -36,32 +44,97 @@ public:
    // -> use this if the object has no state
    shared_ptr<T> load(const string& a_res_id)
    {
-      typename CacheType::iterator it = my_cache.find(a_res_id);
-      if (it != my_cache.end())
-         return (*it).second;
-      else {
-         T* loaded = my_loader(find_resource(a_res_id, my_class));
-         shared_ptr<T> ptr(loaded);
-         my_cache[a_res_id] = ptr;
-         return ptr;
+      EntryPtr e = find_or_add(a_res_id);
+
+      // Don't wait behind other jobs if no worker has started yet
+      run(my_loader, my_class, a_res_id, e);
+
+      try {
+         return e->result.get();
+      }
+      catch (...) {
+         // Allow another attempt the next time it is requested
+         lock_guard<mutex> lock(my_mutex);
+         typename CacheType::iterator it = my_cache.find(a_res_id);
+         if (it != my_cache.end() && (*it).second == e)
+            my_cache.erase(it);
+         throw;
       }
    }
 
    // Make a copy each time a new object is loaded but only
    // parse the XML once
-   // -> use this if the object has state 
+   // -> use this if the object has state
    shared_ptr<T> load_copy(const string& a_res_id)
    {
       shared_ptr<T> original = load(a_res_id);
       return shared_ptr<T>(new T(*original.get()));
    }
-   
+
+   // Start loading on the shared thread pool and return immediately
+   // A later call to load will wait for the result
+   Future load_async(const string& a_res_id)
+   {
+      EntryPtr e = find_or_add(a_res_id);
+
+      if (!e->queued.exchange(true))
+         get_thread_pool()->submit(
+            bind(&ResourceCache<T>::run, my_loader, my_class,
+                 a_res_id, e));
+
+      return e->result;
+   }
+
+   // True once a load started with load_async has finished
+   static bool is_ready(const Future& f)
+   {
+      return f.wait_for(chrono::seconds(0)) == future_status::ready;
+   }
+
 private:
+   struct Entry {
+      Entry()
+         : result(value.get_future()), started(false), queued(false) {}
+
+      promise<shared_ptr<T> > value;
+      Future result;
+      atomic<bool> started, queued;
+   };
+   typedef shared_ptr<Entry> EntryPtr;
+
+   EntryPtr find_or_add(const string& a_res_id)
+   {
+      lock_guard<mutex> lock(my_mutex);
+
+      EntryPtr& e = my_cache[a_res_id];
+      if (!e)
+         e = EntryPtr(new Entry);
+      return e;
+   }
+
+   // Static so a queued job does not refer to the cache itself
+   static void run(LoaderType loader, const string& a_class,
+                   const string& a_res_id, EntryPtr e)
+   {
+      // Whoever gets here first does the load
+      if (e->started.exchange(true))
+         return;
+
+      try {
+         T* loaded = loader(find_resource(a_res_id, a_class));
+         e->value.set_value(shared_ptr<T>(loaded));
+      }
+      catch (...) {
+         e->value.set_exception(current_exception());
+      }
+   }
+
    LoaderType my_loader;
    const string my_class;
-   
-   typedef map<string, shared_ptr<T> > CacheType;
+
+   typedef map<string, EntryPtr> CacheType;
    CacheType my_cache;
+   mutex my_mutex;
 };
 
 #endif
@@ -0,0 +1,68 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INC_SNAPSHOT_BUFFER_HPP
+#define INC_SNAPSHOT_BUFFER_HPP
+
+#include "Platform.hpp"
+
+#include <atomic>
+
+// Passes the latest value of some state from one writer thread to one
+// reader thread without locking
+// There are three copies: the writer fills one while the reader holds
+// another and the third is the most recently published
+template <class T>
+class SnapshotBuffer {
+public:
+   SnapshotBuffer()
+      : latest(1), back_slot(2), front_slot(0)
+   {}
+
+   // The copy the writer may change
+   T& back() { return slots[back_slot]; }
+
+   // Make the back copy the latest and start writing another
+   void publish()
+   {
+      back_slot = latest.exchange(back_slot | FRESH) & SLOT_MASK;
+   }
+
+   // Swap in the latest published copy if there is a new one
+   // Returns true if the front copy changed
+   bool acquire()
+   {
+      if (!(latest.load() & FRESH))
+         return false;
+
+      front_slot = latest.exchange(front_slot) & SLOT_MASK;
+      return true;
+   }
+
+   // The copy the reader is holding
+   const T& front() const { return slots[front_slot]; }
+
+private:
+   static const int SLOT_MASK = 3;
+   static const int FRESH = 4;   // Set when published but not acquired
+
+   T slots[3];
+   atomic<int> latest;
+   int back_slot, front_slot;
+};
+
+#endif
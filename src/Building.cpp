@@ -37,6 +37,7 @@ public:
    void merge(IMeshBufferPtr buf);
    Point<int> size() const;
    IIndustryPtr industry() const;
+   SceneryRef reference() const;
 
    // IXMLSerialisable interface
    xml::element to_xml() const;
@@ -145,6 +146,12 @@ xml::element Building::to_xml() const
       .add_attribute("name", resource->name());
 }
 
+SceneryRef Building::reference() const
+{
+   SceneryRef ref = { SceneryRef::BUILDING, resource->name(), angle };
+   return ref;
+}
+
 static Building* load_building_xml(IResourcePtr a_res)
 {      
    log() << "Loading building from " << a_res->xml_file_name();
@@ -152,11 +159,21 @@ static Building* load_building_xml(IResourcePtr a_res)
    return new Building(a_res);
 }
 
-ISceneryPtr load_building(const string& a_res_id, float angle)
+static ResourceCache<Building>& building_cache()
 {
    static ResourceCache<Building> cache(load_building_xml, "buildings");
-   
-   shared_ptr<Building> bld = cache.load_copy(a_res_id);
+   return cache;
+}
+
+bool prefetch_building(const string& a_res_id)
+{
+   return ResourceCache<Building>::is_ready(
+      building_cache().load_async(a_res_id));
+}
+
+ISceneryPtr load_building(const string& a_res_id, float angle)
+{
+   shared_ptr<Building> bld = building_cache().load_copy(a_res_id);
    bld->set_angle(angle);
 
    return ISceneryPtr(bld);
@@ -39,6 +39,9 @@ namespace {
       Default("YRes", 600),
       Default("NearClip", 0.1f),
       Default("FarClip", 70.0f),
+      Default("PackedVertices", true),
+      Default("TerrainLODDistance", 20.0f),
+      Default("TickRate", 50),
    };
 }
 
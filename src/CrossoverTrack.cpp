@@ -46,6 +46,11 @@ public:
    float segment_length(const track::TravelToken& a_token) const;
    bool is_valid_direction(const track::Direction& a_direction) const;
    track::Connection next_position(const track::TravelToken& a_token) const;
+   void get_exits(const track::TravelToken& a_token,
+                  vector<track::Connection>& output) const
+   {
+      output.push_back(next_position(a_token));
+   }
    void get_endpoints(vector<Point<int> >& a_list) const;
    void get_covers(vector<Point<int> >& output) const { }
    void get_height_locked(vector<Point<int> >& output) const;
@@ -59,9 +64,10 @@ public:
 
    // IXMLSerialisable interface
    xml::element to_xml() const;
+   track::Record record() const;
 
 private:
-   void transform(const track::TravelToken& a_token, float delta) const;
+   MatrixF4 transform(const track::TravelToken& a_token, float delta) const;
 
    Point<int> origin;
    float height;
@@ -133,7 +139,7 @@ CrossoverTrack::get_travel_token(track::Position a_position,
    return tok;
 }
 
-void CrossoverTrack::transform(const track::TravelToken& a_token,
+MatrixF4 CrossoverTrack::transform(const track::TravelToken& a_token,
    float delta) const
 {
    assert(delta < 1.0);
@@ -146,20 +152,23 @@ void CrossoverTrack::transform(const track::TravelToken& a_token,
 
    track::Direction dir = backwards ? -a_token.direction : a_token.direction;
 
-   const double x_trans = dir == axis::X ? delta : 0;
-   const double y_trans = dir == axis::Y ? delta : 0;
+   const float x_trans = dir == axis::X ? delta : 0;
+   const float y_trans = dir == axis::Y ? delta : 0;
 
-   glTranslated(static_cast<double>(origin.x) + x_trans,
+   MatrixF4 m = MatrixF4::translation(
+      static_cast<float>(origin.x) + x_trans,
       height,
-      static_cast<double>(origin.y) + y_trans);
+      static_cast<float>(origin.y) + y_trans);
 
    if (dir == axis::Y)
-      glRotated(-90.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-   glTranslated(-0.5, 0.0, 0.0);
+   m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
 
    if (backwards)
-      glRotated(-180.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-180.0f, MatrixF4::AXIS_Y);
+
+   return m;
 }
 
 bool CrossoverTrack::is_valid_direction(const track::Direction& a_direction) const
@@ -213,6 +222,12 @@ xml::element CrossoverTrack::to_xml() const
    return xml::element("crossover-track");
 }
 
+track::Record CrossoverTrack::record() const
+{
+   track::Record r = { track::Record::CROSSOVER, {} };
+   return r;
+}
+
 ITrackSegmentPtr make_crossover_track()
 {
    return make_shared<CrossoverTrack>();
@@ -42,6 +42,7 @@ public:
    void display(IGraphicsPtr a_context) const;
    void overlay() const;
    void update(IPickBufferPtr pick_buffer, int a_delta);
+   void interpolate(float a_fraction) {}
    void on_key_down(SDLKey a_key);
    void on_key_up(SDLKey a_key);
    void on_mouse_move(IPickBufferPtr pick_buffer,
@@ -658,14 +659,9 @@ void Editor::on_mouse_move(IPickBufferPtr pick_buffer, int x, int y,
 {
    if (am_dragging) {
       // Extend the selection rectangle
-      map->set_pick_mode(true);
-      IGraphicsPtr pick_context = pick_buffer->begin_pick(x, y);
-      display(pick_context);
-      int id = pick_buffer->end_pick();
-      map->set_pick_mode(false);
-
-      if (id > 0)
-	 drag_end = map->pick_position(id);
+      PickResult hit;
+      if (map->pick(pick_buffer->pick_ray(x, y), hit))
+	 drag_end = hit.tile;
    }
    else if (am_scrolling) {
       const float speed = 0.05f;
@@ -690,17 +686,10 @@ void Editor::on_mouse_click(IPickBufferPtr pick_buffer, int x, int y,
 
       if (!clicked_onGUI) {
 	 // See if the user clicked on something in the map
-	 map->set_pick_mode(true);
-	 IGraphicsPtr pick_context = pick_buffer->begin_pick(x, y);
-	 display(pick_context);
-	 int id = pick_buffer->end_pick();
-	 map->set_pick_mode(false);
-
-	 if (id > 0) {
+	 PickResult hit;
+	 if (map->pick(pick_buffer->pick_ray(x, y), hit)) {
 	    // Begin dragging a selection rectangle
-	    PointI where = map->pick_position(id);
-
-	    drag_begin = drag_end = where;
+	    drag_begin = drag_end = hit.tile;
 	    am_dragging = true;
 	 }
       }
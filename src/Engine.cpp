@@ -58,9 +58,13 @@ class Engine : public IRollingStock,
 public:
    Engine(IResourcePtr a_res);
 
+   // Compile the mesh which must happen on the render thread
+   void cache_model() { model->cache(); }
+
    // IRollingStock interface
    void render() const;
    void update(int delta, double gravity);
+   void signal_ahead(SignalAspect aspect, double distance, double gravity);
 
    double speed() const { return my_speed; }
    double mass() const { return my_mass; }
@@ -92,6 +96,7 @@ private:
    int my_throttle;     // Ratio measured in tenths
    bool reverse;
    bool have_stopped;
+   bool held_at_signal;   // Braking for a signal at danger
 
    // Boiler pressure lags behind temperature
    MovingAverage<double, 1000> my_boiler_delay;
@@ -104,6 +109,7 @@ private:
    static const double INIT_PRESSURE, INIT_TEMP;
 
    static const double STOP_SPEED;
+   static const double SIGNAL_MARGIN;
 };
 
 const float Engine::MODEL_SCALE(0.4f);
@@ -111,6 +117,7 @@ const double Engine::TRACTIVE_EFFORT_KNEE(10.0);
 const double Engine::INIT_PRESSURE(0.2);
 const double Engine::INIT_TEMP(50.0);
 const double Engine::STOP_SPEED(0.01);
+const double Engine::SIGNAL_MARGIN(5.0);
 
 Engine::Engine(IResourcePtr a_res)
    : my_speed(0.0), my_mass(29.0),
@@ -120,6 +127,7 @@ Engine::Engine(IResourcePtr a_res)
      is_brake_on(true), my_throttle(0),
      reverse(false),
      have_stopped(true),
+     held_at_signal(false),
      resource(a_res)
 {
    static IXMLParserPtr parser = make_xml_parser("schemas/engine.xsd");
@@ -130,10 +138,8 @@ Engine::Engine(IResourcePtr a_res)
 // Callback for loading elements from the XML file
 void Engine::text(const string& local_name, const string& a_string)
 {
-   if (local_name == "model") {
+   if (local_name == "model")
       model = load_model(resource, a_string, MODEL_SCALE);
-      model->cache();
-   }
 }
 
 // Draw the engine model
@@ -196,19 +202,23 @@ void Engine::update(int delta, double gravity)
    my_boiler_delay << my_fire_temp;
    my_boiler_pressure = my_boiler_delay.value();
 
+   // A signal at danger overrides the driver
+   const bool braking = is_brake_on || held_at_signal;
+   const int throttle = held_at_signal ? 0 : my_throttle;
+
    const double P = tractive_effort();
    const double Q = resistance();
-   const double B = is_brake_on ? brake_force() : 0.0;
+   const double B = braking ? brake_force() : 0.0;
    const double G = gravity;
 
    // The applied tractive effort is controlled by the throttle
-   const double netP = P * static_cast<double>(my_throttle) / 10.0;
+   const double netP = P * static_cast<double>(throttle) / 10.0;
 
    const double delta_seconds = delta / 1000.0f;
    const double a = ((netP - Q - B + G) / my_mass) * delta_seconds;
 
-   if (abs(my_speed) < STOP_SPEED && my_throttle == 0) {
-      if (is_brake_on)
+   if (abs(my_speed) < STOP_SPEED && throttle == 0) {
+      if (braking)
          my_speed = 0.0;
       have_stopped = true;
    }
@@ -226,6 +236,33 @@ void Engine::update(int delta, double gravity)
 #endif
 }
 
+// Start braking once the signal is within stopping distance
+// The deceleration comes from the same forces as update uses with
+// the throttle closed and the brake on
+void Engine::signal_ahead(SignalAspect aspect, double distance,
+                          double gravity)
+{
+   if (aspect != SIGNAL_DANGER) {
+      held_at_signal = false;
+      return;
+   }
+   else if (abs(my_speed) < STOP_SPEED) {
+      held_at_signal = distance <= SIGNAL_MARGIN;
+      return;
+   }
+
+   const double decel = (resistance() + brake_force() - gravity) / my_mass;
+
+   if (decel <= 0.0) {
+      // The brakes cannot hold the train on this slope
+      held_at_signal = true;
+      return;
+   }
+
+   const double stopping = my_speed * my_speed / (2.0 * decel);
+   held_at_signal = distance <= stopping + SIGNAL_MARGIN;
+}
+
 ICargoPtr Engine::cargo() const
 {
    return ICargoPtr();
@@ -266,5 +303,8 @@ static Engine* load_engine_xml(IResourcePtr a_res)
 IRollingStockPtr load_engine(const string& a_res_id)
 {
    static ResourceCache<Engine> cache(load_engine_xml, "engines");
-   return cache.load_copy(a_res_id);
+
+   shared_ptr<Engine> engine = cache.load_copy(a_res_id);
+   engine->cache_model();
+   return engine;
 }
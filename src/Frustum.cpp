@@ -20,6 +20,12 @@
 
 #include <GL/gl.h>
 
+#include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 using namespace std;
 
 /* The sides of the frustum */
@@ -132,6 +138,110 @@ bool Frustum::cuboid_in_frustum(float x,	  float y,	   float z,
    return true;
 }
 
+// Only the corner furthest along each plane normal needs testing to
+// reject a box and only the nearest corner to accept it
+Frustum::Containment Frustum::box_in_frustum(const Vector<float>& lo,
+                                             const Vector<float>& hi,
+                                             unsigned& mask) const
+{
+   for (int i = 0; i < 6; i++) {
+      if (!(mask & (1 << i)))
+         continue;
+
+      const float* p = planes[i];
+
+      const float px = p[A] >= 0.0f ? hi.x : lo.x;
+      const float py = p[B] >= 0.0f ? hi.y : lo.y;
+      const float pz = p[C] >= 0.0f ? hi.z : lo.z;
+
+      if (p[A]*px + p[B]*py + p[C]*pz + p[D] < 0.0f)
+         return OUTSIDE;
+
+      const float nx = p[A] >= 0.0f ? lo.x : hi.x;
+      const float ny = p[B] >= 0.0f ? lo.y : hi.y;
+      const float nz = p[C] >= 0.0f ? lo.z : hi.z;
+
+      if (p[A]*nx + p[B]*ny + p[C]*nz + p[D] >= 0.0f)
+         mask &= ~(1 << i);
+   }
+
+   return mask ? INTERSECTS : INSIDE;
+}
+
+void Frustum::boxes_in_frustum(const Vector<float>* lo,
+                               const Vector<float>* hi,
+                               size_t count, unsigned* visible,
+                               unsigned plane_mask) const
+{
+   fill(visible, visible + (count + 31) / 32, 0u);
+
+   size_t i = 0;
+
+#ifdef __SSE__
+   // Broadcast the planes once and note which corner of the boxes is
+   // furthest along each normal
+   int n_planes = 0;
+   __m128 pa[6], pb[6], pc[6], pd[6];
+   bool pos_x[6], pos_y[6], pos_z[6];
+   for (int p = 0; p < 6; p++) {
+      if (!(plane_mask & (1 << p)))
+         continue;
+
+      pa[n_planes] = _mm_set1_ps(planes[p][A]);
+      pb[n_planes] = _mm_set1_ps(planes[p][B]);
+      pc[n_planes] = _mm_set1_ps(planes[p][C]);
+      pd[n_planes] = _mm_set1_ps(planes[p][D]);
+
+      pos_x[n_planes] = planes[p][A] >= 0.0f;
+      pos_y[n_planes] = planes[p][B] >= 0.0f;
+      pos_z[n_planes] = planes[p][C] >= 0.0f;
+
+      n_planes++;
+   }
+
+   const __m128 zero = _mm_setzero_ps();
+
+   for (; i + 4 <= count; i += 4) {
+      // Transpose four boxes into x, y, and z registers
+      __m128 lx = _mm_load_ps(reinterpret_cast<const float*>(&lo[i]));
+      __m128 ly = _mm_load_ps(reinterpret_cast<const float*>(&lo[i + 1]));
+      __m128 lz = _mm_load_ps(reinterpret_cast<const float*>(&lo[i + 2]));
+      __m128 lw = _mm_load_ps(reinterpret_cast<const float*>(&lo[i + 3]));
+      _MM_TRANSPOSE4_PS(lx, ly, lz, lw);
+
+      __m128 hx = _mm_load_ps(reinterpret_cast<const float*>(&hi[i]));
+      __m128 hy = _mm_load_ps(reinterpret_cast<const float*>(&hi[i + 1]));
+      __m128 hz = _mm_load_ps(reinterpret_cast<const float*>(&hi[i + 2]));
+      __m128 hw = _mm_load_ps(reinterpret_cast<const float*>(&hi[i + 3]));
+      _MM_TRANSPOSE4_PS(hx, hy, hz, hw);
+
+      __m128 outside = zero;
+      for (int p = 0; p < n_planes; p++) {
+         const __m128 px = pos_x[p] ? hx : lx;
+         const __m128 py = pos_y[p] ? hy : ly;
+         const __m128 pz = pos_z[p] ? hz : lz;
+
+         const __m128 dist =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], px),
+                                  _mm_mul_ps(pb[p], py)),
+                       _mm_add_ps(_mm_mul_ps(pc[p], pz), pd[p]));
+
+         outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+      }
+
+      // Four boxes never straddle a word as i is a multiple of four
+      const unsigned in = ~_mm_movemask_ps(outside) & 0xf;
+      visible[i / 32] |= in << (i % 32);
+   }
+#endif
+
+   for (; i < count; i++) {
+      unsigned mask = plane_mask;
+      if (box_in_frustum(lo[i], hi[i], mask) != OUTSIDE)
+         visible[i / 32] |= 1u << (i % 32);
+   }
+}
+
 // Extract the view frustum from OpenGL
 Frustum get_view_frustum()
 {
@@ -20,6 +20,7 @@
 #include "IMap.hpp"
 #include "IRollingStock.hpp"
 #include "ITrain.hpp"
+#include "ISimulationThread.hpp"
 #include "ILogger.hpp"
 #include "ILight.hpp"
 #include "GameScreens.hpp"
@@ -34,6 +35,8 @@
 #include "gui/ThrottleMeter.hpp"
 #include "gui/IFont.hpp"
 
+#include <atomic>
+
 // Implementation of the main play screen
 class Game : public IScreen {
 public:
@@ -43,6 +46,7 @@ public:
    void display(IGraphicsPtr a_context) const;
    void overlay() const;
    void update(IPickBufferPtr a_pick_buffer, int a_delta);
+   void interpolate(float a_fraction);
    void on_key_down(SDLKey a_key);
    void on_key_up(SDLKey a_key);
    void on_mouse_move(IPickBufferPtr a_pick_buffer, int x, int y,
@@ -53,6 +57,7 @@ public:
                          MouseButton a_button);
 private:
    void look_ahead();
+   void refresh_look_ahead(track::Position tile, track::Direction dir);
    void near_station(IStationPtr s);
    void left_station();
    Vector<float> camera_position(float a_radius) const;
@@ -61,14 +66,33 @@ private:
 
    enum TrackStateReq { NEXT, PREV };
    void alter_track_state(TrackStateReq req);
+   void change_points(ITrackSegmentPtr track, TrackStateReq req);
 
    IMapPtr map;
-   ITrainPtr train;
+   ITrainStorePtr trains;
+   ITrainPtr train;   // The one the player drives
    ILightPtr sun;
 
+   // Moves the trains independently of rendering
+   ISimulationThreadPtr simulation;
+
    // Station the train is either approaching or stopped at
    IStationPtr active_station;
 
+   // Result of the last look along the track from the train which
+   // is kept until the train moves to another tile or points change
+   struct LookAhead {
+      track::Position tile;
+      track::Direction direction;
+      unsigned points_changes;
+      TrackIterator it;   // Where the look stopped
+      bool on_station;    // Sitting on it.station
+   } ahead;
+   bool ahead_valid;
+
+   // Bumped on the simulation thread after the points change
+   atomic<unsigned> points_changes;
+
    // Camera position
    float horiz_angle, vert_angle, view_radius;
 
@@ -80,6 +104,10 @@ private:
    enum CameraMode { CAMERA_FLOATING, CAMERA_BIRD };
    CameraMode camera_mode;
 
+   // Fraction of a simulation tick between the train snapshot and
+   // this frame
+   float tick_fraction;
+
    gui::ILayoutPtr layout;
    IMessageAreaPtr message_area;
    IRenderStatsPtr render_stats;
@@ -87,12 +115,16 @@ private:
 
 Game::Game(IMapPtr a_map)
    : map(a_map),
+     ahead_valid(false),
+     points_changes(0),
      horiz_angle(M_PI/4.0f),
      vert_angle(M_PI/4.0f),
      view_radius(20.0f),
-     panning(false)
+     panning(false),
+     tick_fraction(0.0f)
 {
-   train = make_train(map);
+   trains = make_train_store(map);
+   train = trains->add_train(0.0f);
    sun = make_sun_light();
 
    map->set_grid(false);
@@ -105,11 +137,15 @@ Game::Game(IMapPtr a_map)
    // Intial camera state is floating but in the bird position
    switch_to_bird_camera();
    camera_mode = CAMERA_FLOATING;
+
+   using namespace placeholders;
+   simulation = make_simulation_thread(bind(&ITrainStore::update, trains, _1));
 }
 
 Game::~Game()
 {
-
+   // Stop the simulation before the trains are destroyed
+   simulation.reset();
 }
 
 Vector<float> Game::camera_position(float a_radius) const
@@ -117,7 +153,7 @@ Vector<float> Game::camera_position(float a_radius) const
    // Two angles give unique position on surface of a sphere
    // Look up ``spherical coordinates''
    const float y_centre = 0.9f;
-   Vector<float> position = train->front();
+   Vector<float> position = train->front(tick_fraction);
    position.x += a_radius * cosf(horiz_angle) * sinf(vert_angle);
    position.z += a_radius * sinf(horiz_angle) * sinf(vert_angle);
    position.y = a_radius * cosf(vert_angle) + y_centre;
@@ -137,7 +173,7 @@ void Game::switch_to_bird_camera()
 
 void Game::display(IGraphicsPtr a_context) const
 {
-   Vector<float> train_pos = train->front();
+   Vector<float> train_pos = train->front(tick_fraction);
 
    Vector<float> position = camera_position(view_radius);
 
@@ -147,7 +183,7 @@ void Game::display(IGraphicsPtr a_context) const
    sun->apply();
 
    map->render(a_context);
-   train->render();
+   trains->render(tick_fraction);
 
    render_billboards();
 }
@@ -163,13 +199,21 @@ void Game::stopped_at_station()
    //layout->get("/station").visible(true);
 }
 
+// The train runs on the simulation thread so frames are interpolated
+// using its tick rather than the window's
+void Game::interpolate(float a_fraction)
+{
+   trains->sync();
+   tick_fraction = trains->tick_fraction();
+}
+
 void Game::update(IPickBufferPtr a_pick_buffer, int a_delta)
 {
+   simulation->check_errors();
+
    message_area->update(a_delta);
    render_stats->update(a_delta);
 
-   train->update(a_delta);
-
    // Update the GUI elements
    layout->cast<gui::ThrottleMeter>("/throttle_meter").value(
       train->controller()->throttle());
@@ -184,6 +228,9 @@ void Game::update(IPickBufferPtr a_pick_buffer, int a_delta)
 
    look_ahead();
 
+   if (train->signal_aspect() == SIGNAL_DANGER)
+      message_area->post("Signal at danger!", 60);
+
    // Move the camera vertically if it's currently underground
 #if 0
    // Calculate the location of the near clip plane
@@ -235,11 +282,17 @@ void Game::left_station()
 // that they are approaching
 void Game::look_ahead()
 {
-   TrackIterator it = iterate_track(map, train->tile(),
-      train->direction());
+   const track::Position tile = train->tile();
+   const track::Direction dir = train->direction();
+
+   if (!ahead_valid || tile != ahead.tile || dir != ahead.direction
+       || points_changes != ahead.points_changes)
+      refresh_look_ahead(tile, dir);
+
+   const TrackIterator& it = ahead.it;
 
    // Are we sitting on a station?
-   if (it.status == TRACK_STATION) {
+   if (ahead.on_station) {
       near_station(it.station);
 
       if (train->controller()->stopped())
@@ -250,38 +303,46 @@ void Game::look_ahead()
       return;
    }
 
+   switch (it.status) {
+   case TRACK_STATION:
+      message_area->post("Approaching station " + it.station->name());
+      near_station(it.station);
+      return;
+   case TRACK_NO_MORE:
+      message_area->post("Oh no! You're going to crash!");
+      return;
+   case TRACK_CHOICE:
+      message_area->post("Oh no! You have to make a decision!");
+      it.track->set_state_render_hint();
+      return;
+   default:
+      // We're not approaching any station
+      left_station();
+      break;
+   }
+}
+
+// Walk along the track until something interesting is found
+void Game::refresh_look_ahead(track::Position tile, track::Direction dir)
+{
+   ahead.tile = tile;
+   ahead.direction = dir;
+   ahead.points_changes = points_changes;
+   ahead_valid = true;
+
+   ahead.it = iterate_track(map, tile, dir);
+   ahead.on_station = ahead.it.status == TRACK_STATION;
+
+   if (ahead.on_station)
+      return;
+
    const int max_look = 10;
    for (int i = 0; i < max_look; i++) {
-      it = it.next();
+      ahead.it = ahead.it.next();
 
-      if (it.status != TRACK_OK) {
-         bool clear_station = true;
-
-         switch (it.status) {
-         case TRACK_STATION:
-            message_area->post("Approaching station " + it.station->name());
-            near_station(it.station);
-            clear_station = false;
-            return;
-         case TRACK_NO_MORE:
-            message_area->post("Oh no! You're going to crash!");
-            break;
-         case TRACK_CHOICE:
-            message_area->post("Oh no! You have to make a decision!");
-            it.track->set_state_render_hint();
-            break;
-         default:
-            break;
-         }
-
-         if (!clear_station)
-            left_station();
+      if (ahead.it.status != TRACK_OK)
          return;
-      }
    }
-
-   // We're not approaching any station
-   left_station();
 }
 
 void Game::alter_track_state(TrackStateReq req)
@@ -299,15 +360,8 @@ void Game::alter_track_state(TrackStateReq req)
       it = it.next();
 
       if (it.status == TRACK_CHOICE) {
-         switch (req) {
-         case NEXT:
-            it.track->next_state();
-            break;
-         case PREV:
-            it.track->prev_state();
-            break;
-         }
-
+         // The train reads the track state during each tick
+         simulation->post(bind(&Game::change_points, this, it.track, req));
          return;
       }
    }
@@ -315,6 +369,21 @@ void Game::alter_track_state(TrackStateReq req)
    warn() << "No nearby track state to change";
 }
 
+// Runs on the simulation thread
+void Game::change_points(ITrackSegmentPtr track, TrackStateReq req)
+{
+   switch (req) {
+   case NEXT:
+      track->next_state();
+      break;
+   case PREV:
+      track->prev_state();
+      break;
+   }
+
+   ++points_changes;
+}
+
 void Game::on_key_down(SDLKey a_key)
 {
    switch (a_key) {
@@ -21,6 +21,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 
 #ifdef WIN32
 #include <io.h>   // For _isatty
@@ -41,6 +42,10 @@ public:
 
 namespace {
    bool is_stdoutTTY;
+
+   // Held from write_msg until the PrintLine is destroyed so lines
+   // from different threads are not interleaved
+   recursive_mutex line_mutex;
 }
 
 LoggerImpl::LoggerImpl()
@@ -61,6 +66,8 @@ LoggerImpl::LoggerImpl()
 
 PrintLinePtr LoggerImpl::write_msg(LogMsgType type)
 {
+   line_mutex.lock();
+
    if (is_stdoutTTY)
       cout << "\x1B[1m";
 
@@ -99,6 +106,8 @@ PrintLine::~PrintLine()
       cout << "\x1B[0m";
 
    stream << endl;
+
+   line_mutex.unlock();
 }
 
 // Return the single instance of Logger
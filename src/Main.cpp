@@ -21,9 +21,14 @@
 #include "IResource.hpp"
 #include "IConfig.hpp"
 #include "ITrackGraph.hpp"
+#include "IRoutePlanner.hpp"
+#include "ITrain.hpp"
+#include "ISimulationThread.hpp"
 
 #include <stdexcept>
 #include <iostream>
+#include <chrono>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -39,13 +44,134 @@ namespace {
    int new_map_width = 32;
    int new_map_height = 32;
    int run_cycles = 0;
+   int sim_seconds = 60;
+   int sim_throttle = 5;
+   int sim_trains = 1;
+
+   // Distance along the line between trains in the simulation
+   const float SIM_TRAIN_SPACING = 8.0f;
    string map_file;
    string action;
 }
 
+// Write out the track graph and the shortest route between every
+// pair of stations on it
 static void dump_track_graph(IMapPtr map)
 {
-   make_track_graph(map)->write_dot_file(map_file + ".dot");
+   typedef chrono::steady_clock Clock;
+
+   ITrackGraphPtr track_graph = make_track_graph(map);
+   track_graph->write_dot_file(map_file + ".dot");
+
+   vector<IStationPtr> stations;
+   for (unsigned n = 0; n < track_graph->node_count(); n++) {
+      const graph::Node& node = track_graph->node(n);
+      if (node.type == graph::NODE_STATION)
+         stations.push_back(node.station);
+   }
+
+   IRoutePlannerPtr planner = make_route_planner(map);
+
+   // Plan twice to show the effect of the cache
+   for (int pass = 0; pass < 2; pass++) {
+      const Clock::time_point start = Clock::now();
+
+      for (auto& from : stations) {
+         for (auto& to : stations) {
+            Route route;
+            const bool found = planner->find_route(from, to, route);
+
+            if (pass == 0 && from != to) {
+               if (found)
+                  log() << from->name() << " to " << to->name() << ": "
+                        << route.length << " via " << route.steps.size()
+                        << " arcs";
+               else
+                  log() << from->name() << " to " << to->name()
+                        << ": no route";
+            }
+         }
+      }
+
+      const chrono::duration<double, milli> elapsed = Clock::now() - start;
+      log() << "Planned " << stations.size() * stations.size()
+            << " routes in " << elapsed.count() << "ms"
+            << (pass == 0 ? "" : " from the cache");
+   }
+}
+
+// Drive trains around the map as fast as possible without a window
+// and report how long it took
+static void run_simulation(IMapPtr map)
+{
+   typedef chrono::steady_clock Clock;
+
+   ITrainStorePtr trains = make_train_store(map);
+
+   for (int t = 0; t < sim_trains; t++) {
+      IControllerPtr ctrl =
+         trains->add_train(t * SIM_TRAIN_SPACING)->controller();
+      ctrl->act_on(BRAKE_TOGGLE);
+      for (int i = 0; i < sim_throttle; i++)
+         ctrl->act_on(THROTTLE_UP);
+   }
+
+   const int tick_ms = simulation_tick_ms();
+   const int max_ticks = sim_seconds * 1000 / tick_ms;
+
+   double distance = 0.0, max_speed = 0.0, speed_sum = 0.0;
+   double worst_tick = 0.0;
+   int ticks = 0;
+
+   vector<VectorF> last_pos;
+   for (int t = 0; t < sim_trains; t++)
+      last_pos.push_back(trains->train(t)->front(1.0f));
+
+   const Clock::time_point start = Clock::now();
+
+   try {
+      for (; ticks < max_ticks; ticks++) {
+         const Clock::time_point tick_start = Clock::now();
+
+         trains->update(tick_ms);
+         trains->sync();
+
+         const chrono::duration<double, milli> tick_time =
+            Clock::now() - tick_start;
+         worst_tick = max(worst_tick, tick_time.count());
+
+         for (int t = 0; t < sim_trains; t++) {
+            ITrainPtr train = trains->train(t);
+
+            const VectorF pos = train->front(1.0f);
+            distance += (pos - last_pos[t]).length();
+            last_pos[t] = pos;
+
+            max_speed = max(max_speed, abs(train->speed()));
+            speed_sum += abs(train->speed());
+         }
+      }
+   }
+   catch (const runtime_error& e) {
+      warn() << "Simulation stopped after " << ticks << " ticks: "
+             << e.what();
+   }
+
+   const chrono::duration<double> wall = Clock::now() - start;
+   const double simulated = ticks * tick_ms / 1000.0;
+
+   const int samples = ticks * sim_trains;
+
+   cout << "Simulated " << sim_trains << " trains for " << simulated
+        << "s in " << ticks << " ticks of " << tick_ms << "ms" << endl
+        << "   wall time   " << wall.count() * 1000.0 << "ms ("
+        << (wall.count() > 0.0 ? simulated / wall.count() : 0.0)
+        << "x real time)" << endl
+        << "   per tick    " << (ticks > 0 ? wall.count() * 1e3 / ticks : 0.0)
+        << "ms average, " << worst_tick << "ms worst" << endl
+        << "   distance    " << distance << " tiles in total" << endl
+        << "   speed       " << (samples > 0 ? speed_sum / samples : 0.0)
+        << "m/s average, " << max_speed << "m/s max" << endl;
 }
 
 static void parse_options(int argc, char** argv)
@@ -57,9 +183,13 @@ static void parse_options(int argc, char** argv)
       ("help", "Display this help message")
       ("width", value<int>(&new_map_width), "Set new map width")
       ("height", value<int>(&new_map_height), "Set new map height")
-      ("action", value<string>(&action), "Either `play' or `edit'")
+      ("action", value<string>(&action),
+       "One of `play', `edit', `graph' or `simulate'")
       ("map", value<string>(&map_file), "Name of map to load or create")
       ("cycles", value<int>(&run_cycles), "Run for N frames")
+      ("seconds", value<int>(&sim_seconds), "Simulate for N seconds")
+      ("throttle", value<int>(&sim_throttle), "Throttle setting to simulate")
+      ("trains", value<int>(&sim_trains), "Number of trains to simulate")
       ;
 
    positional_options_description p;
@@ -105,13 +235,13 @@ int main(int argc, char** argv)
 
    try {
       if (::action == "" || (::map_file == "" && ::action != "uidemo"))
-         throw runtime_error("Usage: TrainGame (edit|play) [map]");
+         throw runtime_error("Usage: TrainGame (edit|play|simulate) [map]");
 
       init_resources();
 
       IConfigPtr cfg = get_config();
 
-      bool no_window = action == "graph";
+      bool no_window = action == "graph" || action == "simulate";
 
       if (!no_window)
          ::window = make_sdl_window();
@@ -134,6 +264,9 @@ int main(int argc, char** argv)
       else if (::action == "graph") {
          dump_track_graph(load_map(::map_file));
       }
+      else if (::action == "simulate") {
+         run_simulation(load_map(::map_file));
+      }
       else
          throw runtime_error("Unrecognised command: " + ::action);
 
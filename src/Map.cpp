@@ -30,13 +30,18 @@
 #include "IConfig.hpp"
 #include "OpenGLHelper.hpp"
 #include "ClipVolume.hpp"
+#include "IThreadPool.hpp"
+#include "MappedFile.hpp"
 
 #include <stdexcept>
 #include <sstream>
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <set>
 #include <map>
+#include <limits>
+#include <mutex>
 
 #include <boost/filesystem.hpp>
 #include <boost/cstdint.hpp>
@@ -70,10 +75,179 @@ private:
 typedef shared_ptr<Anchor<ITrackSegment> > TrackAnchor;
 typedef shared_ptr<Anchor<IScenery> > SceneryAnchor;
 
+// Layout of the compiled map which is memory mapped at load time
+// instead of parsing the XML and height map
+// Every field after the header is four bytes wide so all the sections
+// stay aligned
+namespace compiled {
+   const char MAGIC[4] = { 'T', 'G', 'M', 'B' };
+   const int32_t FORMAT_VERSION = 2;
+
+   // The XML and height map a compiled map was generated from
+   // It is only used if these match the files exactly
+   struct Source {
+      int64_t xml_time, xml_size;
+      int64_t bin_time, bin_size;   // -1 if there is no height map
+   };
+
+   // Followed by the sections in this order:
+   //   (width + 1) * (depth + 1) vertex heights
+   //   Stations, Track, StationPart, Scenery
+   //   String table of NUL terminated strings
+   struct Header {
+      char magic[4];
+      int32_t version;
+      int32_t width, depth;
+      int32_t start_x, start_y, start_dir_x, start_dir_y;
+      int32_t n_stations, n_tracks, n_station_parts, n_scenery;
+      int32_t strings_size;
+      int32_t pad;   // Aligns source
+      Source source;
+   };
+
+   Source source_of(IResourcePtr res)
+   {
+      using namespace boost::filesystem;
+
+      const path xml_file(res->xml_file_name());
+      const path bin_file = xml_file.parent_path() / (res->name() + ".bin");
+
+      Source s = {
+         last_write_time(xml_file),
+         static_cast<int64_t>(file_size(xml_file)),
+         -1, -1
+      };
+
+      if (exists(bin_file)) {
+         s.bin_time = last_write_time(bin_file);
+         s.bin_size = static_cast<int64_t>(file_size(bin_file));
+      }
+
+      return s;
+   }
+
+   bool operator==(const Source& a, const Source& b)
+   {
+      return a.xml_time == b.xml_time && a.xml_size == b.xml_size
+         && a.bin_time == b.bin_time && a.bin_size == b.bin_size;
+   }
+
+   struct Station {
+      int32_t id;
+      int32_t name;   // Offset into the string table
+   };
+
+   struct Track {
+      int32_t x, y;
+      track::Record record;
+   };
+
+   struct StationPart {
+      int32_t x, y, id;
+   };
+
+   struct Scenery {
+      int32_t x, y;
+      int32_t kind;
+      int32_t name;   // Offset into the string table
+      float angle;
+   };
+
+   // Bounds checked cursor over a mapped file
+   class Reader {
+   public:
+      Reader(const MappedFile& file) : file(file), offset(0) {}
+
+      template <class T>
+      const T* take(size_t count)
+      {
+         if (count > (file.size() - offset) / sizeof(T))
+            throw runtime_error(file.file_name() + " is truncated");
+
+         const T* p = reinterpret_cast<const T*>(file.data() + offset);
+         offset += sizeof(T) * count;
+         return p;
+      }
+
+      bool at_end() const { return offset == file.size(); }
+
+   private:
+      const MappedFile& file;
+      size_t offset;
+   };
+
+   size_t count(int32_t n)
+   {
+      if (n < 0)
+         throw runtime_error("Negative count in compiled map");
+      return static_cast<size_t>(n);
+   }
+
+   int32_t add_string(string& table, const string& s)
+   {
+      const int32_t offset = static_cast<int32_t>(table.size());
+      table += s;
+      table += '\0';
+      return offset;
+   }
+
+   string string_at(const char* table, int32_t size, int32_t offset)
+   {
+      if (offset < 0 || offset >= size)
+         throw runtime_error("Bad string offset in compiled map");
+      return string(table + offset);
+   }
+
+   template <class T>
+   void write(ostream& os, const vector<T>& v)
+   {
+      if (!v.empty())
+         os.write(reinterpret_cast<const char*>(&v[0]), sizeof(T) * v.size());
+   }
+}
+
+// Output of building a sector on a worker thread
+struct SectorBuffers {
+   IMeshBufferPtr objects;   // Track and scenery, null if not rebuilt
+   IMeshBufferPtr terrain;   // Terrain at the requested detail level
+   SectorLOD lod;
+};
+
+// Sector meshes built by the worker threads waiting to be uploaded
+// on the render thread
+class FinishedMeshes {
+public:
+   void put(int id, const SectorBuffers& bufs)
+   {
+      lock_guard<mutex> lock(my_mutex);
+      my_buffers[id] = bufs;
+   }
+
+   bool take(int id, SectorBuffers& bufs)
+   {
+      lock_guard<mutex> lock(my_mutex);
+
+      map<int, SectorBuffers>::iterator it = my_buffers.find(id);
+      if (it == my_buffers.end())
+         return false;
+
+      bufs = (*it).second;
+      my_buffers.erase(it);
+      return true;
+   }
+
+private:
+   mutex my_mutex;
+   map<int, SectorBuffers> my_buffers;
+};
+
+typedef shared_ptr<FinishedMeshes> FinishedMeshesPtr;
+
 class Map : public IMap,
             public ISectorRenderable,
             public enable_shared_from_this<Map> {
    friend class MapLoader;
+   friend IMapPtr load_map(const string& a_res_id);
 public:
    Map(IResourcePtr a_res);
    ~Map();
@@ -88,7 +262,6 @@ public:
    void set_start(int x, int y);
    void set_start(int x, int y, int dirX, int dirY);
    void set_grid(bool on_off);
-   void set_pick_mode(bool on_off) { in_pick_mode = on_off; }
 
    track::Connection start() const;
    ITrackSegmentPtr track_at(const PointI& a_point) const;
@@ -98,9 +271,14 @@ public:
    void render(IGraphicsPtr a_context) const;
    void highlight_tile(PointI point, Colour colour) const;
    void highlight_vertex(PointI point, Colour colour) const;
+   bool pick(const Ray& ray, PickResult& result) const;
    void reset_map(int a_width, int a_depth);
    void erase_tile(int x, int y);
    bool empty_tile(PointI tile) const;
+   unsigned track_generation() const;
+   void track_changes(unsigned since, PointList& output) const;
+   void hold_track_changes(unsigned generation);
+   void release_track_changes(unsigned generation);
 
    void raise_area(const PointI& a_start_pos,
                    const PointI& a_finish_pos);
@@ -124,9 +302,12 @@ public:
 
    // ISectorRenderable interface
    void render_sector(IGraphicsPtr a_context, int id,
-                      PointI bot_left, PointI top_right);
+                      PointI bot_left, PointI top_right,
+                      const SectorLOD& lod);
    void post_render_sector(IGraphicsPtr a_context, int id,
                            PointI bot_left, PointI top_right);
+   void height_range(PointI bot_left, PointI top_right,
+                     float& low, float& high) const;
 
 private:
    // Tiles on the map
@@ -145,22 +326,52 @@ private:
       int lock_count;
    } *height_map;
 
-   static const unsigned TILE_NAME_BASE	= 1000;	 // Base of tile naming
-   static const unsigned NULL_OBJECT	= 0;	 // Non-existent object
    static const float TILE_HEIGHT;	         // Standard height increment
+   static const float SEA_LEVEL;
+   static const float SKIRT_DEPTH;             // Bottom of the map sides
+   static const float SCENERY_HEIGHT;          // Tallest tree or building
 
    // Meshes for each terrain sector
-   vector<IMeshPtr> terrain_meshes;
+   struct Sector {
+      Sector()
+         : terrain_key(-1), building(false), generation(0), failed(false) {}
+
+      IMeshPtr objects;      // Merged track and scenery
+      IMeshPtr terrain;      // Terrain at the last detail level built
+      int      terrain_key;  // lod_key of terrain
+      bool     building;     // A worker thread is generating a new mesh
+      unsigned generation;   // Value of dirty_generation when last built
+      bool     failed;       // Building this generation threw an error
+   };
+   vector<Sector> sectors;
+
+   // Copy of the map data a worker thread needs to build a sector mesh
+   struct SectorJob {
+      PointI bot_left, top_right;
+      int map_width, map_depth;
+      vector<HeightMap> heights;   // Vertices covering the sector
+      vector<function<void (IMeshBufferPtr)> > merges;
+      bool with_objects;   // False if only the terrain is rebuilt
+      ITexturePtr noise;
+      SectorLOD lod;
+
+      const HeightMap& vertex(int x, int y) const
+      {
+         const int row = top_right.x - bot_left.x + 1;
+         return heights[(x - bot_left.x) + (y - bot_left.y) * row];
+      }
+   };
+   typedef shared_ptr<SectorJob> SectorJobPtr;
 
-   inline int index(int x, int y) const
+   static int lod_key(const SectorLOD& lod)
    {
-      assert(x < my_width && y < my_depth && x >= 0 && y >= 0);
-      return x + y*my_width;
+      return (lod.level << 4) | lod.coarser;
    }
 
-   inline int tile_name(int x, int z) const
+   inline int index(int x, int y) const
    {
-      return TILE_NAME_BASE + index(x, z);
+      assert(x < my_width && y < my_depth && x >= 0 && y >= 0);
+      return x + y*my_width;
    }
 
    inline Tile& tile_at(int x, int z) const
@@ -179,25 +390,17 @@ private:
       return height_map[i];
    }
 
-   bool is_valid_tileName(unsigned a_name) const
-   {
-      return a_name >= TILE_NAME_BASE
-         && a_name < TILE_NAME_BASE + my_width * my_depth;
-   }
-
-   PointI pick_position(unsigned a_name) const
-   {
-      assert(is_valid_tileName(a_name));
-
-      int a = a_name - TILE_NAME_BASE;
-      return make_point(a % my_width, a / my_width);
-   }
-
    void write_height_map() const;
    void save_to(ostream& of);
    void read_height_map(IResource::Handle a_handle);
+   void write_compiled() const;
+   void read_compiled(const MappedFile& file);
+   void heights_changed();
+   PointI compiled_tile(int32_t x, int32_t y) const;
+   ITrackSegmentPtr make_slope_at(PointI where, track::Direction axis) const;
+   ITrackSegmentPtr track_from_record(PointI where,
+                                      const track::Record& r) const;
    void tile_vertices(int x, int y, int* indexes) const;
-   void render_pick_sector(PointI bot_left, PointI top_right);
    void draw_start_location() const;
    void set_station_at(PointI point, IStationPtr a_station);
    void render_highlighted_tiles() const;
@@ -205,9 +408,25 @@ private:
    void unlock_height_at(PointI p);
 
    // Mesh modification
-   void build_mesh(int id, PointI bot_left, PointI top_right);
-   bool have_mesh(int id, PointI bot_left, PointI top_right);
+   void update_mesh(int id, PointI bot_left, PointI top_right,
+                    const SectorLOD& lod);
+   void snapshot_heights(SectorJob& job, PointI bot_left,
+                         PointI top_right) const;
+   SectorJobPtr make_sector_job(int id, PointI bot_left, PointI top_right,
+                                const SectorLOD& lod);
+   SectorJobPtr make_terrain_job(PointI bot_left, PointI top_right,
+                                 const SectorLOD& lod) const;
+   static void run_sector_job(FinishedMeshesPtr finished, int id,
+                              SectorJobPtr job);
+   static IMeshBufferPtr build_objects(const SectorJob& job);
+   static IMeshBufferPtr build_terrain(const SectorJob& job);
+   static HeightMap lod_vertex(const SectorJob& job, int x, int y);
+   static Colour height_colour(float h);
+   static ITexturePtr noise_texture();
    void dirty_tile(int x, int y);
+   void dirty_point(int x, int y);
+   int dirty_index(PointI bot_left) const;
+   void track_changed(int x, int y);
 
    // Terrain modification
    void change_area_height(const PointI& a_start_pos,
@@ -222,10 +441,15 @@ private:
    track::Direction start_direction;
    IQuadTreePtr  quad_tree;
    IFogPtr       fog;
-   bool          should_draw_grid_lines, in_pick_mode;
-   list<PointI>  dirty_tiles;
+   bool          should_draw_grid_lines;
+   vector<unsigned> dirty_generation;   // Bumped on each change to a leaf
+   PointList     changed_track;      // Tiles in order of track changes
+   unsigned      first_track_change; // Generation of changed_track[0]
+   multiset<unsigned> track_readers; // Generations held by readers
+   int           leaves_across, leaves_down;
    IResourcePtr  resource;
    vector<bool>  sea_sectors;
+   FinishedMeshesPtr finished_meshes;
 
    // Variables used during rendering
    mutable int frame_num;
@@ -233,13 +457,17 @@ private:
 };
 
 const float Map::TILE_HEIGHT(0.2f);
+const float Map::SEA_LEVEL(-0.6f);
+const float Map::SKIRT_DEPTH(-3.0f);
+const float Map::SCENERY_HEIGHT(4.0f);
 
 Map::Map(IResourcePtr a_res)
    : tiles(NULL), height_map(NULL), my_width(0), my_depth(0),
      start_location(make_point(1, 1)),
      start_direction(axis::X),
-     should_draw_grid_lines(false), in_pick_mode(false),
-     resource(a_res), frame_num(0)
+     should_draw_grid_lines(false),
+     first_track_change(0), leaves_across(0), leaves_down(0),
+     resource(a_res), finished_meshes(new FinishedMeshes), frame_num(0)
 {
    float far_clip;
    get_config()->get("FarClip", far_clip);
@@ -273,6 +501,51 @@ IStationPtr Map::station_at(PointI point) const
 void Map::set_station_at(PointI point, IStationPtr station)
 {
    tile_at(point).station = station;
+   track_changed(point.x, point.y);
+}
+
+void Map::track_changed(int x, int y)
+{
+   // Nothing needs the tile if no one is reading the changes such
+   // as while the map is loading
+   if (track_readers.empty())
+      first_track_change++;
+   else
+      changed_track.push_back(make_point(x, y));
+}
+
+unsigned Map::track_generation() const
+{
+   return first_track_change + changed_track.size();
+}
+
+void Map::track_changes(unsigned since, PointList& output) const
+{
+   assert(since >= first_track_change && since <= track_generation());
+   output.insert(output.end(),
+                 changed_track.begin() + (since - first_track_change),
+                 changed_track.end());
+}
+
+void Map::hold_track_changes(unsigned generation)
+{
+   assert(generation >= first_track_change);
+   track_readers.insert(generation);
+}
+
+// Drop a reader's generation and trim the changes no one needs
+void Map::release_track_changes(unsigned generation)
+{
+   multiset<unsigned>::iterator it = track_readers.find(generation);
+   assert(it != track_readers.end());
+   track_readers.erase(it);
+
+   const unsigned oldest =
+      track_readers.empty() ? track_generation() : *track_readers.begin();
+
+   changed_track.erase(changed_track.begin(),
+                       changed_track.begin() + (oldest - first_track_change));
+   first_track_change = oldest;
 }
 
 void Map::erase_tile(int x, int y)
@@ -296,6 +569,7 @@ void Map::erase_tile(int x, int y)
       for (auto& p : covers) {
          tile_at(p.x, p.y).track.reset();
          dirty_tile(p.x, p.y);
+         track_changed(p.x, p.y);
       }
    }
 
@@ -316,6 +590,7 @@ void Map::erase_tile(int x, int y)
    if (tile.station) {
       tile.station.reset();
       dirty_tile(x, y);
+      track_changed(x, y);
    }
 }
 
@@ -349,6 +624,7 @@ void Map::set_track_at(const PointI& where, ITrackSegmentPtr track)
       tile_at((*it).x, (*it).y).track = node;
 
       dirty_tile((*it).x, (*it).y);
+      track_changed((*it).x, (*it).y);
    }
 
    // Lock every height node touched by this track segment
@@ -452,6 +728,12 @@ void Map::reset_map(int a_width, int a_depth)
 
    // Create quad tree
    quad_tree = make_quad_tree(shared_from_this(), my_width, my_depth);
+
+   // Start every leaf at a generation no mesh has been built for
+   const int leaf = quad_tree->leaf_size();
+   leaves_across = (my_width + leaf - 1) / leaf;
+   leaves_down = (my_depth + leaf - 1) / leaf;
+   dirty_generation.assign(leaves_across * leaves_down, 1);
 }
 
 void Map::highlight_vertex(PointI point, Colour colour) const
@@ -473,6 +755,152 @@ void Map::highlight_tile(PointI point, Colour colour) const
    highlighted_tiles.push_back(make_tuple(point, colour));
 }
 
+// Moller-Trumbore ray/triangle intersection: sets `t' to the distance
+// along the ray of the hit
+static bool ray_hits_triangle(const Ray& ray, const VectorF& a,
+                              const VectorF& b, const VectorF& c, float& t)
+{
+   const VectorF e1 = b - a;
+   const VectorF e2 = c - a;
+
+   const VectorF p = ray.direction * e2;
+   const float det = e1.dot(p);
+   if (abs(det) < 1e-6f)
+      return false;   // Parallel to the triangle
+
+   const float inv_det = 1.0f / det;
+   const VectorF s = ray.origin - a;
+
+   const float u = s.dot(p) * inv_det;
+   if (u < 0.0f || u > 1.0f)
+      return false;
+
+   const VectorF q = s * e1;
+   const float v = ray.direction.dot(q) * inv_det;
+   if (v < 0.0f || u + v > 1.0f)
+      return false;
+
+   t = e2.dot(q) * inv_det;
+   return t >= 0.0f;
+}
+
+// Walk the tiles under the ray in the order it crosses them and stop
+// at the first one whose triangles it hits
+bool Map::pick(const Ray& ray, PickResult& result) const
+{
+   const VectorF& o = ray.origin;
+   const VectorF& d = ray.direction;
+
+   const float huge = numeric_limits<float>::max();
+
+   // Clip the ray against the edges of the map in the xz plane
+   const float origin[2] = { o.x, o.z };
+   const float dir[2] = { d.x, d.z };
+   const float hi[2] = { my_width - 0.5f, my_depth - 0.5f };
+
+   float t_enter = 0.0f, t_exit = huge;
+   for (int i = 0; i < 2; i++) {
+      if (abs(dir[i]) < 1e-6f) {
+         if (origin[i] < -0.5f || origin[i] > hi[i])
+            return false;
+      }
+      else {
+         float t0 = (-0.5f - origin[i]) / dir[i];
+         float t1 = (hi[i] - origin[i]) / dir[i];
+         if (t0 > t1)
+            swap(t0, t1);
+
+         t_enter = max(t_enter, t0);
+         t_exit = min(t_exit, t1);
+      }
+   }
+
+   if (t_enter > t_exit)
+      return false;
+
+   const VectorF start = o + d * t_enter;
+   int x = max(0, min(my_width - 1, int(floor(start.x + 0.5f))));
+   int y = max(0, min(my_depth - 1, int(floor(start.z + 0.5f))));
+
+   const int step_x = d.x > 0.0f ? 1 : -1;
+   const int step_y = d.z > 0.0f ? 1 : -1;
+
+   // Distance along the ray to the next tile boundary on each axis
+   // and between successive boundaries
+   float next_x = huge, next_y = huge;
+   float delta_x = huge, delta_y = huge;
+   if (abs(d.x) >= 1e-6f) {
+      next_x = (x + 0.5f * step_x - o.x) / d.x;
+      delta_x = 1.0f / abs(d.x);
+   }
+   if (abs(d.z) >= 1e-6f) {
+      next_y = (y + 0.5f * step_y - o.z) / d.z;
+      delta_y = 1.0f / abs(d.z);
+   }
+
+   float t_tile = t_enter;
+   while (x >= 0 && x < my_width && y >= 0 && y < my_depth
+          && t_tile <= t_exit) {
+
+      int indexes[4];
+      tile_vertices(x, y, indexes);
+
+      float low = huge, high = -huge;
+      for (int i = 0; i < 4; i++) {
+         low = min(low, height_map[indexes[i]].pos.y);
+         high = max(high, height_map[indexes[i]].pos.y);
+      }
+
+      // Skip the triangle tests if the ray passes wholly above or
+      // below this tile
+      const float t_leave = min(min(next_x, next_y), t_exit);
+      const float y_in = o.y + d.y * t_tile;
+      const float y_out = o.y + d.y * t_leave;
+
+      if (min(y_in, y_out) <= high && max(y_in, y_out) >= low) {
+         const VectorF& v0 = height_map[indexes[0]].pos;
+         const VectorF& v1 = height_map[indexes[1]].pos;
+         const VectorF& v2 = height_map[indexes[2]].pos;
+         const VectorF& v3 = height_map[indexes[3]].pos;
+
+         float t, best = huge;
+         if (ray_hits_triangle(ray, v1, v2, v3, t))
+            best = t;
+         if (ray_hits_triangle(ray, v3, v0, v1, t))
+            best = min(best, t);
+
+         if (best < huge) {
+            result.tile = make_point(x, y);
+            result.position = o + d * best;
+
+            const int vx = int(floor(result.position.x + 1.0f));
+            const int vy = int(floor(result.position.z + 1.0f));
+            result.vertex = make_point(max(0, min(my_width, vx)),
+                                       max(0, min(my_depth, vy)));
+
+            const Tile& tile = tile_at(x, y);
+            result.scenery =
+               tile.scenery ? tile.scenery->get() : ISceneryPtr();
+
+            return true;
+         }
+      }
+
+      if (next_x < next_y) {
+         t_tile = next_x;
+         next_x += delta_x;
+         x += step_x;
+      }
+      else {
+         t_tile = next_y;
+         next_y += delta_y;
+         y += step_y;
+      }
+   }
+
+   return false;
+}
+
 void Map::render_highlighted_tiles() const
 {
    // At the end of the render loop, draw the highlighted tiles over
@@ -492,9 +920,6 @@ void Map::render_highlighted_tiles() const
       const PointI& point = get<0>(*it);
       Colour colour = get<1>(*it);
 
-      // User should be able to click on the highlight as well
-      glPushName(tile_name(point.x, point.y));
-
       colour.a = 0.5f;
       gl::colour(colour);
       glBegin(GL_POLYGON);
@@ -509,8 +934,6 @@ void Map::render_highlighted_tiles() const
       }
 
       glEnd();
-
-      glPopName();
    }
 
    glPopAttrib();
@@ -588,49 +1011,231 @@ void Map::draw_start_location() const
    glPopAttrib();
 }
 
-// Check to see if the given id contains a valid mesh and ensure the
-// array is large enough to hold it
-bool Map::have_mesh(int id, PointI bot_left, PointI top_right)
+// Record that the mesh containing a tile needs rebuilding
+void Map::dirty_tile(int x, int y)
 {
-   if (id >= static_cast<int>(terrain_meshes.size()))
-      terrain_meshes.resize(id + 1);
+   quad_tree->update_heights(make_point(x, y), make_point(x + 1, y + 1));
 
-   bool ok = static_cast<bool>(terrain_meshes[id]);
-   list<PointI>::iterator it = dirty_tiles.begin();
+   dirty_point(x, y);
 
-   while (it != dirty_tiles.end()) {
-      bool covered =
-         (*it).x >= bot_left.x
-         && (*it).x <= top_right.x
-         && (*it).y >= bot_left.y
-         && (*it).y <= top_right.y;
+   // Mark its neighbours as well since the vertices of a tile sit
+   // on mesh boundaries
+   dirty_point(x, y + 1);
+   dirty_point(x, y - 1);
+   dirty_point(x + 1, y);
+   dirty_point(x - 1, y);
+}
 
-      if (covered) {
-         ok = false;
-         it = dirty_tiles.erase(it);
+// Bump the generation of every quad tree leaf touching a point,
+// including those whose far edge it lies on
+void Map::dirty_point(int x, int y)
+{
+   if (x < 0 || y < 0)
+      return;
+
+   const int leaf = quad_tree->leaf_size();
+
+   const int x1 = max(0, (x + leaf - 1) / leaf - 1);
+   const int x2 = min(leaves_across - 1, x / leaf);
+   const int y1 = max(0, (y + leaf - 1) / leaf - 1);
+   const int y2 = min(leaves_down - 1, y / leaf);
+
+   for (int lx = x1; lx <= x2; lx++) {
+      for (int ly = y1; ly <= y2; ly++)
+         ++dirty_generation[lx + ly*leaves_across];
+   }
+}
+
+// Index into dirty_generation of the leaf starting at this point
+int Map::dirty_index(PointI bot_left) const
+{
+   const int leaf = quad_tree->leaf_size();
+   return bot_left.x / leaf + (bot_left.y / leaf) * leaves_across;
+}
+
+// Upload any meshes the workers have finished for this sector and start
+// a rebuild if it is missing, dirty or at the wrong detail level. The
+// old meshes are drawn until the new ones arrive
+void Map::update_mesh(int id, PointI bot_left, PointI top_right,
+                      const SectorLOD& lod)
+{
+   if (id >= static_cast<int>(sectors.size()))
+      sectors.resize(id + 1);
+
+   Sector& sector = sectors[id];
+
+   SectorBuffers bufs;
+   if (sector.building && finished_meshes->take(id, bufs)) {
+      if (bufs.terrain) {
+         sector.terrain = make_mesh(bufs.terrain);
+         sector.terrain_key = lod_key(bufs.lod);
+
+         if (!bufs.objects)
+            ;   // Only the detail level changed
+         else if (bufs.objects->vertex_count() > 0)
+            sector.objects = make_mesh(bufs.objects);
+         else
+            sector.objects.reset();
       }
-      else
-         ++it;
+      else {
+         // Do not try again until the sector changes
+         sector.failed = true;
+      }
+      sector.building = false;
+   }
+
+   if (sector.building)
+      return;
+
+   const unsigned generation = dirty_generation[dirty_index(bot_left)];
+
+   if (sector.generation != generation) {
+      get_thread_pool()->submit(
+         bind(&Map::run_sector_job, finished_meshes, id,
+              make_sector_job(id, bot_left, top_right, lod)));
+
+      sector.building = true;
+      sector.generation = generation;
+      sector.failed = false;
    }
+   else if (sector.terrain_key != lod_key(lod) && !sector.failed) {
+      // The camera has moved to a new detail level
+      get_thread_pool()->submit(
+         bind(&Map::run_sector_job, finished_meshes, id,
+              make_terrain_job(bot_left, top_right, lod)));
 
-   return ok;
+      sector.building = true;
+   }
 }
 
-// Record that the mesh containing a tile needs rebuilding
-void Map::dirty_tile(int x, int y)
+// Called on a worker thread
+void Map::run_sector_job(FinishedMeshesPtr finished, int id, SectorJobPtr job)
 {
-   dirty_tiles.push_back(make_point(x, y));
+   SectorBuffers bufs;
+   bufs.lod = job->lod;
 
-   // Push its neighbours as well since the vertices of a tile sit
-   // on mesh boundaries
-   dirty_tiles.push_back(make_point(x, y + 1));
-   dirty_tiles.push_back(make_point(x, y - 1));
-   dirty_tiles.push_back(make_point(x + 1, y));
-   dirty_tiles.push_back(make_point(x - 1, y));
+   try {
+      if (job->with_objects)
+         bufs.objects = build_objects(*job);
+      bufs.terrain = build_terrain(*job);
+   }
+   catch (const exception& e) {
+      error() << "Failed to build mesh for sector " << id
+              << ": " << e.what();
+      bufs.objects.reset();
+      bufs.terrain.reset();
+   }
+
+   // Always post a result so the sector is not left waiting forever
+   finished->put(id, bufs);
+}
+
+ITexturePtr Map::noise_texture()
+{
+   // The texture must be created on the GL thread
+   static ITexturePtr noise = make_noise_texture(25, 512, 190, 15);
+   return noise;
+}
+
+// Copy the vertices covering a sector
+void Map::snapshot_heights(SectorJob& job, PointI bot_left,
+                           PointI top_right) const
+{
+   job.bot_left = bot_left;
+   job.top_right = top_right;
+   job.map_width = my_width;
+   job.map_depth = my_depth;
+
+   job.heights.reserve((top_right.x - bot_left.x + 1)
+                       * (top_right.y - bot_left.y + 1));
+   for (int y = bot_left.y; y <= top_right.y; y++) {
+      for (int x = bot_left.x; x <= top_right.x; x++)
+         job.heights.push_back(height_map[x + y*(my_width + 1)]);
+   }
+}
+
+// A job that only rebuilds the terrain of a sector
+Map::SectorJobPtr Map::make_terrain_job(PointI bot_left, PointI top_right,
+                                        const SectorLOD& lod) const
+{
+   SectorJobPtr job(new SectorJob);
+   snapshot_heights(*job, bot_left, top_right);
+   job->with_objects = false;
+   job->lod = lod;
+   job->noise = noise_texture();
+
+   return job;
+}
+
+// Copy the heights needed to build a sector mesh so the worker threads
+// never touch the height map
+// Track and scenery are not copied: the workers call merge on the live
+// ITrackSegment and IScenery objects, kept alive by the bound pointers.
+// This is safe as merge only reads the geometry set before an object is
+// placed on the map and editing a tile replaces its object rather than
+// changing it
+Map::SectorJobPtr Map::make_sector_job(int id, PointI bot_left,
+                                       PointI top_right, const SectorLOD& lod)
+{
+   SectorJobPtr job = make_terrain_job(bot_left, top_right, lod);
+   job->with_objects = true;
+
+   // Incrementing the frame counter here ensures that any track which spans
+   // multiple sectors will be merged with each applicable mesh even when
+   // the meshes are built on the same frame
+   ++frame_num;
+
+   // Static scenery and track are merged in the same order as before
+   for (int x = top_right.x-1; x >= bot_left.x; x--) {
+      for (int y = bot_left.y; y < top_right.y; y++) {
+         Tile& tile = tile_at(x, y);
+
+         if (tile.scenery && tile.scenery->needs_rendering(frame_num)) {
+            job->merges.push_back(
+               bind(&IScenery::merge, tile.scenery->get(),
+                    placeholders::_1));
+            tile.scenery->rendered_on(frame_num);
+         }
+
+         if (tile.track && tile.track->needs_rendering(frame_num)) {
+            job->merges.push_back(
+               bind(&ITrackSegment::merge, tile.track->get(),
+                    placeholders::_1));
+            tile.track->rendered_on(frame_num);
+         }
+      }
+   }
+
+   // Check if this sector needs a sea quad drawn
+   bool below_sea_level = false;
+   for (int x = top_right.x-1; x >= bot_left.x; x--) {
+      for (int y = bot_left.y; y < top_right.y; y++) {
+         int index[4];
+         tile_vertices(x, y, index);
+
+         below_sea_level |=
+            height_at(index[0]).pos.y < 0.0f
+            || height_at(index[1]).pos.y < 0.0f
+            || height_at(index[2]).pos.y < 0.0f
+            || height_at(index[3]).pos.y < 0.0f;
+
+         if (below_sea_level)
+            goto below_sea_levelOut;
+      }
+   }
+
+ below_sea_levelOut:
+
+   size_t min_size = id + 1;
+   if (sea_sectors.size() < min_size)
+      sea_sectors.resize(min_size);
+   sea_sectors.at(id) = below_sea_level;
+
+   return job;
 }
 
-// Generate a terrain mesh for a particular sector
-void Map::build_mesh(int id, PointI bot_left, PointI top_right)
+// Terrain colour for a given height
+Colour Map::height_colour(float h)
 {
    static const tuple<float, Colour> colour_map[] = {
       //          Start height         colour
@@ -642,69 +1247,99 @@ void Map::build_mesh(int id, PointI bot_left, PointI top_right)
       make_tuple(   -1e10f,    make_rgb(177, 176, 96) )
    };
 
+   tuple<float, Colour> hcol;
+   int j = 0;
+   do {
+      hcol = colour_map[j++];
+   } while (get<0>(hcol) > h);
+
+   return get<1>(hcol);
+}
+
+// Merge the static scenery and track in a sector
+IMeshBufferPtr Map::build_objects(const SectorJob& job)
+{
    IMeshBufferPtr buf = make_mesh_buffer();
 
-   // Incrementing the frame counter here ensures that any track which spans
-   // multiple sectors will be merged with each applicable mesh even when
-   // the meshes are built on the same frame
-   ++frame_num;
+   for (auto& merge : job.merges)
+      merge(buf);
 
-   static ITexturePtr noise = make_noise_texture(25, 512, 190, 15);
-   buf->bind(noise);
+   return buf;
+}
 
-   const float tmul = 1.0f / float(top_right.x - bot_left.x + 1);
+// Terrain vertex at this detail level. Vertices on an edge shared with
+// a coarser sector are moved onto the line between their neighbours as
+// the other sector skips them. This stops cracks opening up
+Map::HeightMap Map::lod_vertex(const SectorJob& job, int x, int y)
+{
+   const int step = 1 << job.lod.level;
+   const unsigned coarser = job.lod.coarser;
 
-   for (int x = top_right.x-1; x >= bot_left.x; x--) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
-         int indexes[4];
-         tile_vertices(x, y, indexes);
+   const bool odd_x = ((x - job.bot_left.x) / step) % 2 == 1;
+   const bool odd_y = ((y - job.bot_left.y) / step) % 2 == 1;
 
-         const int order[6] = {
-            indexes[1], indexes[2], indexes[3],
-            indexes[3], indexes[0], indexes[1]
-         };
+   const bool on_coarse_x =
+      (x == job.bot_left.x && (coarser & EDGE_LEFT))
+      || (x == job.top_right.x && (coarser & EDGE_RIGHT));
+   const bool on_coarse_y =
+      (y == job.bot_left.y && (coarser & EDGE_BOTTOM))
+      || (y == job.top_right.y && (coarser & EDGE_TOP));
 
-         const IMeshBuffer::TexCoord tex_coords[4] = {
-            make_point(x * tmul, (y + 1) * tmul),
-            make_point((x + 1) * tmul, (y + 1) * tmul),
-            make_point((x + 1) * tmul, y * tmul),
-            make_point(x * tmul, y * tmul)
-         };
+   const HeightMap* a;
+   const HeightMap* b;
+   if (on_coarse_x && odd_y) {
+      a = &job.vertex(x, y - step);
+      b = &job.vertex(x, y + step);
+   }
+   else if (on_coarse_y && odd_x) {
+      a = &job.vertex(x - step, y);
+      b = &job.vertex(x + step, y);
+   }
+   else
+      return job.vertex(x, y);
 
-         const IMeshBuffer::TexCoord tex_order[6] = {
-            tex_coords[1], tex_coords[2], tex_coords[3],
-            tex_coords[3], tex_coords[0], tex_coords[1]
-         };
+   HeightMap mid = *a;
+   mid.pos = (a->pos + b->pos) * 0.5f;
+   mid.normal = (a->normal + b->normal).normalise();
+   return mid;
+}
 
-         for (int i = 0; i < 6; i++) {
-            const HeightMap& v = height_map[order[i]];
+// Generate the terrain mesh for a sector at one detail level
+IMeshBufferPtr Map::build_terrain(const SectorJob& job)
+{
+   const PointI& bot_left = job.bot_left;
+   const PointI& top_right = job.top_right;
+   const int step = 1 << job.lod.level;
 
-            const float h = v.pos.y;
-            tuple<float, Colour> hcol;
-            int j = 0;
-            do {
-               hcol = colour_map[j++];
-            } while (get<0>(hcol) > h);
+   IMeshBufferPtr buf = make_mesh_buffer();
 
-            buf->add(v.pos, v.normal, get<1>(hcol), tex_order[i]);
-         }
-      }
-   }
+   buf->bind(job.noise);
 
-   // Merge any static scenery
-   for (int x = top_right.x-1; x >= bot_left.x; x--) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
-         Tile& tile = tile_at(x, y);
+   const float tmul = 1.0f / float(top_right.x - bot_left.x + 1);
 
-         if (tile.scenery && tile.scenery->needs_rendering(frame_num)) {
-            tile.scenery->get()->merge(buf);
-            tile.scenery->rendered_on(frame_num);
-         }
+   for (int x = top_right.x-step; x >= bot_left.x; x -= step) {
+      for (int y = bot_left.y; y < top_right.y; y += step) {
+         // Same order as tile_vertices
+         const HeightMap corners[4] = {
+            lod_vertex(job, x, y + step),
+            lod_vertex(job, x + step, y + step),
+            lod_vertex(job, x + step, y),
+            lod_vertex(job, x, y)
+         };
 
-         // Draw the track, if any
-         if (tile.track && tile.track->needs_rendering(frame_num)) {
-            tile.track->get()->merge(buf);
-            tile.track->rendered_on(frame_num);
+         const int order[6] = { 1, 2, 3, 3, 0, 1 };
+
+         const IMeshBuffer::TexCoord tex_coords[4] = {
+            make_point(x * tmul, (y + step) * tmul),
+            make_point((x + step) * tmul, (y + step) * tmul),
+            make_point((x + step) * tmul, y * tmul),
+            make_point(x * tmul, y * tmul)
+         };
+
+         for (int i = 0; i < 6; i++) {
+            const HeightMap& v = corners[order[i]];
+            buf->add(v.pos, v.normal, height_colour(v.pos.y),
+                     tex_coords[order[i]]);
          }
       }
    }
@@ -714,152 +1349,85 @@ void Map::build_mesh(int id, PointI bot_left, PointI top_right)
    const float x2 = static_cast<float>(top_right.x) - 0.5f;
    const float y1 = static_cast<float>(bot_left.y) - 0.5f;
    const float y2 = static_cast<float>(top_right.y) - 0.5f;
+   const float fstep = static_cast<float>(step);
 
    const Colour brown = make_rgb(104, 57, 12);
-   const float depth = -3.0f;
+   const float depth = SKIRT_DEPTH;
 
    buf->bind(ITexturePtr());   // No texture on sides
 
-   int index[4];
-
    if (bot_left.x == 0) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
+      for (int y = bot_left.y; y < top_right.y; y += step) {
          const float yf = static_cast<float>(y) - 0.5f;
 
-         tile_vertices(0, y, index);
-
-         const float h1 = height_at(index[3]).pos.y;
-         const float h2 = height_at(index[0]).pos.y;
+         const float h1 = lod_vertex(job, 0, y).pos.y;
+         const float h2 = lod_vertex(job, 0, y + step).pos.y;
 
          buf->add_quad(make_vector(x1, h1, yf),
             make_vector(x1, depth, yf),
-            make_vector(x1, depth, yf + 1.0f),
-            make_vector(x1, h2, yf + 1.0f),
+            make_vector(x1, depth, yf + fstep),
+            make_vector(x1, h2, yf + fstep),
             brown);
       }
    }
 
-   if (top_right.x == my_width) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
+   if (top_right.x == job.map_width) {
+      for (int y = bot_left.y; y < top_right.y; y += step) {
          const float yf = static_cast<float>(y) - 0.5f;
 
-         tile_vertices(my_width - 1, y, index);
-
-         const float h1 = height_at(index[2]).pos.y;
-         const float h2 = height_at(index[1]).pos.y;
+         const float h1 = lod_vertex(job, job.map_width, y).pos.y;
+         const float h2 = lod_vertex(job, job.map_width, y + step).pos.y;
 
          buf->add_quad(make_vector(x2, depth, yf),
             make_vector(x2, h1, yf),
-            make_vector(x2, h2, yf + 1.0f),
-            make_vector(x2, depth, yf + 1.0f),
+            make_vector(x2, h2, yf + fstep),
+            make_vector(x2, depth, yf + fstep),
             brown);
       }
    }
 
    if (bot_left.y == 0) {
-      for (int x = bot_left.x; x < top_right.x; x++) {
+      for (int x = bot_left.x; x < top_right.x; x += step) {
          const float xf = static_cast<float>(x) - 0.5f;
 
-         tile_vertices(x, 0, index);
-
-         const float h1 = height_at(index[3]).pos.y;
-         const float h2 = height_at(index[2]).pos.y;
+         const float h1 = lod_vertex(job, x, 0).pos.y;
+         const float h2 = lod_vertex(job, x + step, 0).pos.y;
 
          buf->add_quad(make_vector(xf, depth, y1),
             make_vector(xf, h1, y1),
-            make_vector(xf + 1.0f, h2, y1),
-            make_vector(xf + 1.0f, depth, y1),
+            make_vector(xf + fstep, h2, y1),
+            make_vector(xf + fstep, depth, y1),
             brown);
       }
    }
 
-   if (top_right.y == my_depth) {
-      for (int x = bot_left.x; x < top_right.x; x++) {
+   if (top_right.y == job.map_depth) {
+      for (int x = bot_left.x; x < top_right.x; x += step) {
          const float xf = static_cast<float>(x) - 0.5f;
 
-         tile_vertices(x, my_depth - 1, index);
-
-         const float h1 = height_at(index[0]).pos.y;
-         const float h2 = height_at(index[1]).pos.y;
+         const float h1 = lod_vertex(job, x, job.map_depth).pos.y;
+         const float h2 = lod_vertex(job, x + step, job.map_depth).pos.y;
 
          buf->add_quad(make_vector(xf, h1, y2),
             make_vector(xf, depth, y2),
-            make_vector(xf + 1.0f, depth, y2),
-            make_vector(xf + 1.0f, h2, y2),
+            make_vector(xf + fstep, depth, y2),
+            make_vector(xf + fstep, h2, y2),
             brown);
       }
    }
 
-   terrain_meshes[id] = make_mesh(buf);
-
-   // Check if this sector needs a sea quad drawn
-   bool below_sea_level = false;
-   for (int x = top_right.x-1; x >= bot_left.x; x--) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
-         int index[4];
-         tile_vertices(x, y, index);
-
-         below_sea_level |=
-            height_at(index[0]).pos.y < 0.0f
-            || height_at(index[1]).pos.y < 0.0f
-            || height_at(index[2]).pos.y < 0.0f
-            || height_at(index[3]).pos.y < 0.0f;
-
-         if (below_sea_level)
-            goto below_sea_levelOut;
-      }
-   }
-
- below_sea_levelOut:
-
-   size_t min_size = id + 1;
-   if (sea_sectors.size() < min_size)
-      sea_sectors.resize(min_size);
-   sea_sectors.at(id) = below_sea_level;
-
-   // Make sure we don't rebuild this mesh if any of the tiles are dirty
-   have_mesh(id, bot_left, top_right);
-}
-
-// A special rendering mode when selecting tiles
-void Map::render_pick_sector(PointI bot_left, PointI top_right)
-{
-   glColor3f(1.0f, 1.0f, 1.0f);
-
-   for (int x = top_right.x-1; x >= bot_left.x; x--) {
-      for (int y = bot_left.y; y < top_right.y; y++) {
-         // Name this tile
-         glPushName(tile_name(x, y));
-
-         int indexes[4];
-         tile_vertices(x, y, indexes);
-
-         glBegin(GL_QUADS);
-         for (int i = 0; i < 4; i++) {
-            const HeightMap& v = height_map[indexes[i]];
-            glNormal3f(v.normal.x, v.normal.y, v.normal.z);
-            glVertex3f(v.pos.x, v.pos.y, v.pos.z);
-         }
-         glEnd();
-
-         glPopName();
-      }
-   }
+   return buf;
 }
 
 // Render a small part of the map as directed by the quad tree
 void Map::render_sector(IGraphicsPtr a_context, int id,
-                        PointI bot_left, PointI top_right)
+                        PointI bot_left, PointI top_right,
+                        const SectorLOD& lod)
 {
-   if (in_pick_mode) {
-      render_pick_sector(bot_left, top_right);
-      return;
-   }
-
-   if (!have_mesh(id, bot_left, top_right))
-      build_mesh(id, bot_left, top_right);
+   update_mesh(id, bot_left, top_right, lod);
 
-   {
+   IMeshPtr terrain = sectors[id].terrain;
+   if (terrain) {
       // Parts of track may extend outside the sector so these
       // are clipped off
 
@@ -869,7 +1437,10 @@ void Map::render_sector(IGraphicsPtr a_context, int id,
       const float d = quad_tree->leaf_size();
       ClipVolume clip(x, w, z, d);
 
-      terrain_meshes[id]->render();
+      terrain->render();
+
+      if (sectors[id].objects)
+         sectors[id].objects->render();
    }
 
    // Draw the overlays
@@ -954,7 +1525,7 @@ void Map::post_render_sector(IGraphicsPtr a_context, int id,
                              PointI bot_left, PointI top_right)
 {
    // Draw the water
-   if (!in_pick_mode && sea_sectors.at(id)) {
+   if (sea_sectors.at(id)) {
       glPushAttrib(GL_ENABLE_BIT);
 
       glEnable(GL_BLEND);
@@ -965,20 +1536,45 @@ void Map::post_render_sector(IGraphicsPtr a_context, int id,
       const float trX = static_cast<float>(top_right.x);
       const float trY = static_cast<float>(top_right.y);
 
-      static const float sea_level = -0.6f;
       gl::colour(make_rgb(0, 80, 160, 150));
       glNormal3f(0.0f, 1.0f, 0.0f);
       glBegin(GL_QUADS);
-      glVertex3f(blX - 0.5f, sea_level, blY - 0.5f);
-      glVertex3f(blX - 0.5f, sea_level, trY - 0.5f);
-      glVertex3f(trX - 0.5f, sea_level, trY - 0.5f);
-      glVertex3f(trX - 0.5f, sea_level, blY - 0.5f);
+      glVertex3f(blX - 0.5f, SEA_LEVEL, blY - 0.5f);
+      glVertex3f(blX - 0.5f, SEA_LEVEL, trY - 0.5f);
+      glVertex3f(trX - 0.5f, SEA_LEVEL, trY - 0.5f);
+      glVertex3f(trX - 0.5f, SEA_LEVEL, blY - 0.5f);
       glEnd();
 
       glPopAttrib();
    }
 }
 
+// Used by the quad tree to build bounding boxes for culling
+void Map::height_range(PointI bot_left, PointI top_right,
+                       float& low, float& high) const
+{
+   low = high = height_map[bot_left.x + bot_left.y*(my_width + 1)].pos.y;
+
+   for (int y = bot_left.y; y <= top_right.y; y++) {
+      for (int x = bot_left.x; x <= top_right.x; x++) {
+         const float h = height_map[x + y*(my_width + 1)].pos.y;
+         low = min(low, h);
+         high = max(high, h);
+      }
+   }
+
+   // The water is drawn over any sector below sea level
+   if (low < 0.0f)
+      low = min(low, SEA_LEVEL);
+
+   const bool edge = bot_left.x == 0 || bot_left.y == 0
+      || top_right.x == my_width || top_right.y == my_depth;
+   if (edge)
+      low = SKIRT_DEPTH;
+
+   high += SCENERY_HEIGHT;
+}
+
 // Called when we've changed the height of part of a tile
 // This readjusts all the normals and those of its neighbours
 // to point in the right direction
@@ -1516,10 +2112,19 @@ void Map::read_height_map(IResource::Handle a_handle)
       height_map[i].lock_count = 0;
    }
 
+   heights_changed();
+}
+
+// Recompute the normals and bounds after loading new heights
+void Map::heights_changed()
+{
    for (int x = 0; x < my_width; x++) {
       for (int y = 0; y < my_depth; y++)
          fix_normals(x, y);
    }
+
+   quad_tree->update_heights(make_point(0, 0),
+                             make_point(my_width, my_depth));
 }
 
 void Map::save_to(ostream& of)
@@ -1614,18 +2219,265 @@ void Map::save()
 {
    using namespace boost::filesystem;
 
-   IResource::Handle h = resource->write_file(resource->name() + ".xml");
+   {
+      IResource::Handle h = resource->write_file(resource->name() + ".xml");
 
-   log() << "Saving map to " << h.file_name();
+      log() << "Saving map to " << h.file_name();
 
-   ofstream& of = h.wstream();
+      ofstream& of = h.wstream();
 
+      try {
+         save_to(of);
+      }
+      catch (exception& e) {
+         h.rollback();
+         throw e;
+      }
+   }   // The XML must be in place before the compiled map records it
+
+   // The XML stays the editable source but loading uses this
    try {
-      save_to(of);
+      write_compiled();
    }
    catch (exception& e) {
+      warn() << "Failed to write compiled map: " << e.what();
+   }
+}
+
+// Write the whole map into a single binary file which can be
+// loaded without any parsing: see the compiled namespace above
+void Map::write_compiled() const
+{
+   const int n_vertices = (my_width + 1) * (my_depth + 1);
+   vector<float> heights(n_vertices);
+   for (int i = 0; i < n_vertices; i++)
+      heights[i] = height_map[i].pos.y;
+
+   vector<compiled::Station> stations;
+   vector<compiled::Track> tracks;
+   vector<compiled::StationPart> parts;
+   vector<compiled::Scenery> scenery;
+   string strings;
+
+   set<IStationPtr> seen_stations;
+
+   // Scenery covering several tiles is only written once as in save_to
+   ++frame_num;
+
+   for (int x = 0; x < my_width; x++) {
+      for (int y = 0; y < my_depth; y++) {
+         const Tile& tile = tile_at(x, y);
+
+         if (tile.track && tile.track->origin() == make_point(x, y)) {
+            compiled::Track t = { x, y, tile.track->get()->record() };
+            tracks.push_back(t);
+         }
+
+         if (tile.station) {
+            if (seen_stations.find(tile.station) == seen_stations.end()) {
+               compiled::Station s = {
+                  tile.station->id(),
+                  compiled::add_string(strings, tile.station->name())
+               };
+               stations.push_back(s);
+               seen_stations.insert(tile.station);
+            }
+
+            compiled::StationPart p = { x, y, tile.station->id() };
+            parts.push_back(p);
+         }
+
+         if (tile.scenery && tile.scenery->needs_rendering(frame_num)) {
+            const SceneryRef ref = tile.scenery->get()->reference();
+            const PointI& origin = tile.scenery->origin();
+            compiled::Scenery s = {
+               origin.x, origin.y, ref.kind,
+               compiled::add_string(strings, ref.name), ref.angle
+            };
+            scenery.push_back(s);
+            tile.scenery->rendered_on(frame_num);
+         }
+      }
+   }
+
+   const compiled::Header header = {
+      { compiled::MAGIC[0], compiled::MAGIC[1],
+        compiled::MAGIC[2], compiled::MAGIC[3] },
+      compiled::FORMAT_VERSION,
+      my_width, my_depth,
+      start_location.x, start_location.y,
+      start_direction.x, start_direction.z,
+      static_cast<int32_t>(stations.size()),
+      static_cast<int32_t>(tracks.size()),
+      static_cast<int32_t>(parts.size()),
+      static_cast<int32_t>(scenery.size()),
+      static_cast<int32_t>(strings.size()),
+      0,
+      compiled::source_of(resource)
+   };
+
+   IResource::Handle h = resource->write_file(resource->name() + ".tgm");
+
+   log() << "Writing compiled map to " << h.file_name();
+
+   try {
+      ofstream& of = h.wstream();
+
+      of.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      compiled::write(of, heights);
+      compiled::write(of, stations);
+      compiled::write(of, tracks);
+      compiled::write(of, parts);
+      compiled::write(of, scenery);
+      of.write(strings.data(), strings.size());
+
+      of.flush();
+      if (!of.good())
+         throw runtime_error("Failed writing " + h.file_name());
+   }
+   catch (...) {
       h.rollback();
-      throw e;
+      throw;
+   }
+}
+
+PointI Map::compiled_tile(int32_t x, int32_t y) const
+{
+   if (x < 0 || y < 0 || x >= my_width || y >= my_depth)
+      throw runtime_error("Tile outside the map in compiled map");
+   return make_point(x, y);
+}
+
+// Load a map written by write_compiled
+// The whole file is checked before the map is changed
+void Map::read_compiled(const MappedFile& file)
+{
+   using namespace compiled;
+
+   Reader reader(file);
+
+   const Header* header = reader.take<Header>(1);
+   if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+      throw runtime_error(file.file_name() + " is not a compiled map");
+   else if (header->version != FORMAT_VERSION)
+      throw runtime_error(file.file_name() + " has an old version");
+   else if (header->width <= 0 || header->depth <= 0)
+      throw runtime_error(file.file_name() + " has bad dimensions");
+
+   const size_t n_vertices =
+      (count(header->width) + 1) * (count(header->depth) + 1);
+
+   const float* heights = reader.take<float>(n_vertices);
+   const Station* stations =
+      reader.take<Station>(count(header->n_stations));
+   const Track* tracks = reader.take<Track>(count(header->n_tracks));
+   const StationPart* parts =
+      reader.take<StationPart>(count(header->n_station_parts));
+   const Scenery* scenery = reader.take<Scenery>(count(header->n_scenery));
+   const char* strings = reader.take<char>(count(header->strings_size));
+
+   if (!reader.at_end())
+      throw runtime_error(file.file_name() + " has trailing data");
+   else if (header->strings_size > 0
+            && strings[header->strings_size - 1] != '\0')
+      throw runtime_error(file.file_name() + " has a bad string table");
+
+   // Load the scenery on worker threads while the terrain and track
+   // are built here
+   for (int i = 0; i < header->n_scenery; i++) {
+      const string name =
+         string_at(strings, header->strings_size, scenery[i].name);
+
+      if (scenery[i].kind == SceneryRef::TREE)
+         prefetch_tree(name);
+      else if (scenery[i].kind == SceneryRef::BUILDING)
+         prefetch_building(name);
+   }
+
+   reset_map(header->width, header->depth);
+
+   for (size_t i = 0; i < n_vertices; i++)
+      height_map[i].pos.y = heights[i];
+
+   heights_changed();
+
+   // Slope track reads the heights so must come after them
+   map<int, IStationPtr> by_id;
+   for (int i = 0; i < header->n_stations; i++) {
+      IStationPtr s = make_station();
+      s->set_id(stations[i].id);
+      s->set_name(string_at(strings, header->strings_size,
+                            stations[i].name));
+      by_id[stations[i].id] = s;
+   }
+
+   for (int i = 0; i < header->n_tracks; i++) {
+      const PointI where = compiled_tile(tracks[i].x, tracks[i].y);
+      set_track_at(where, track_from_record(where, tracks[i].record));
+   }
+
+   for (int i = 0; i < header->n_station_parts; i++) {
+      map<int, IStationPtr>::iterator it = by_id.find(parts[i].id);
+      if (it == by_id.end())
+         throw runtime_error("No station definition for ID "
+                             + boost::lexical_cast<string>(parts[i].id));
+
+      set_station_at(compiled_tile(parts[i].x, parts[i].y), (*it).second);
+   }
+
+   for (int i = 0; i < header->n_scenery; i++) {
+      const PointI where = compiled_tile(scenery[i].x, scenery[i].y);
+      const string name =
+         string_at(strings, header->strings_size, scenery[i].name);
+
+      if (scenery[i].kind == SceneryRef::TREE)
+         add_scenery(where, load_tree(name, scenery[i].angle));
+      else if (scenery[i].kind == SceneryRef::BUILDING)
+         add_scenery(where, load_building(name, scenery[i].angle));
+      else
+         throw runtime_error("Unknown scenery in compiled map");
+   }
+
+   set_start(header->start_x, header->start_y,
+             header->start_dir_x, header->start_dir_y);
+}
+
+ITrackSegmentPtr Map::make_slope_at(PointI where,
+                                    track::Direction axis) const
+{
+   bool level;
+   VectorF slope = slope_at(where, axis, level);
+
+   bool a_valid, b_valid;
+   VectorF before = slope_before(where, axis, b_valid);
+   VectorF after = slope_after(where, axis, a_valid);
+
+   if (!a_valid || !b_valid || !level)
+      throw runtime_error("SlopeTrack in invalid location");
+
+   return make_slope_track(axis, slope, before, after);
+}
+
+ITrackSegmentPtr Map::track_from_record(PointI where,
+                                        const track::Record& r) const
+{
+   const int32_t* p = r.params;
+
+   switch (r.type) {
+   case track::Record::STRAIGHT:
+      return make_straight_track(p[0] ? axis::X : axis::Y);
+   case track::Record::SLOPE:
+      return make_slope_at(where, p[0] ? axis::X : axis::Y);
+   case track::Record::POINTS:
+      return make_points(make_vector(p[0], 0, p[1]), p[2] != 0);
+   case track::Record::CROSSOVER:
+      return make_crossover_track();
+   case track::Record::SPLINE:
+      return make_spline_track(make_vector(p[0], p[1], 0),
+                               make_vector(p[2], 0, p[3]),
+                               make_vector(p[4], 0, p[5]));
+   default:
+      throw runtime_error("Unknown track type in compiled map");
    }
 }
 
@@ -1795,18 +2647,7 @@ void MapLoader::handle_slope_track(const AttributeSet& attrs)
 
    track::Direction axis = align == "x" ? axis::X : axis::Y;
 
-   bool level;
-   VectorF slope = my_map->slope_at(tile, axis, level);
-
-   bool a_valid, b_valid;
-   VectorF slope_before = my_map->slope_before(tile, axis, b_valid);
-   VectorF slope_after = my_map->slope_after(tile, axis, a_valid);
-
-   if (!a_valid || !b_valid || !level)
-      throw runtime_error("SlopeTrack in invalid location");
-
-   my_map->set_track_at(tile,
-                        make_slope_track(axis, slope, slope_before, slope_after));
+   my_map->set_track_at(tile, my_map->make_slope_at(tile, axis));
 }
 
 void MapLoader::handle_points(const AttributeSet& attrs)
@@ -1847,10 +2688,49 @@ void MapLoader::handle_spline_track(const AttributeSet& attrs)
    my_map->set_track_at(tile, make_spline_track(delta, entry_dir, exit_dir));
 }
 
+// True if the compiled map was generated from the XML and height map
+// as they are now
+// Comparing against the time of the compiled file itself would miss an
+// XML saved in the same second or restored with an older time
+static bool compiled_map_current(IResourcePtr res, const MappedFile& file)
+{
+   using namespace compiled;
+
+   Reader reader(file);
+   const Header* header = reader.take<Header>(1);
+
+   return memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+      && header->version == FORMAT_VERSION
+      && header->source == source_of(res);
+}
+
 IMapPtr load_map(const string& a_res_id)
 {
    IResourcePtr res = find_resource(a_res_id, "maps");
 
+   const string compiled =
+      (boost::filesystem::path(res->xml_file_name()).parent_path()
+       / (res->name() + ".tgm")).string();
+
+   if (boost::filesystem::exists(compiled)) {
+      try {
+         MappedFile file(compiled);
+
+         if (compiled_map_current(res, file)) {
+            shared_ptr<Map> map(new Map(res));
+
+            log() << "Loading compiled map from file " << compiled;
+
+            map->read_compiled(file);
+
+            return IMapPtr(map);
+         }
+      }
+      catch (runtime_error& e) {
+         warn() << "Ignoring compiled map: " << e.what();
+      }
+   }
+
    shared_ptr<Map> map(new Map(res));
 
    log() << "Loading map from file " << res->xml_file_name();
@@ -1860,5 +2740,13 @@ IMapPtr load_map(const string& a_res_id)
    MapLoader loader(map, res);
    xml_parser->parse(res->xml_file_name(), loader);
 
+   // Next time the XML parsing can be skipped
+   try {
+      map->write_compiled();
+   }
+   catch (exception& e) {
+      warn() << "Failed to write compiled map: " << e.what();
+   }
+
    return IMapPtr(map);
 }
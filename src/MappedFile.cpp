@@ -0,0 +1,102 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#ifdef WIN32
+#include <fstream>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+
+MappedFile::MappedFile(const string& file_name)
+   : file_name_(file_name), data_(NULL), size_(0)
+{
+   ifstream is(file_name.c_str(), ios::binary);
+   if (!is.good())
+      throw runtime_error("Cannot open " + file_name);
+
+   is.seekg(0, ios::end);
+   buffer.resize(static_cast<size_t>(is.tellg()));
+   is.seekg(0, ios::beg);
+
+   if (!buffer.empty()) {
+      is.read(&buffer[0], buffer.size());
+      if (!is.good())
+         throw runtime_error("Failed to read " + file_name);
+
+      data_ = &buffer[0];
+      size_ = buffer.size();
+   }
+}
+
+MappedFile::~MappedFile()
+{
+
+}
+
+#else
+
+MappedFile::MappedFile(const string& file_name)
+   : file_name_(file_name), data_(NULL), size_(0)
+{
+   const int fd = open(file_name.c_str(), O_RDONLY);
+   if (fd < 0)
+      throw runtime_error("Cannot open " + file_name + ": "
+                          + strerror(errno));
+
+   struct stat buf;
+   if (fstat(fd, &buf) < 0) {
+      close(fd);
+      throw runtime_error("Cannot stat " + file_name + ": "
+                          + strerror(errno));
+   }
+
+   // Mapping zero bytes is an error so leave data_ as NULL
+   if (buf.st_size > 0) {
+      void* ptr = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) {
+         close(fd);
+         throw runtime_error("Cannot map " + file_name + ": "
+                             + strerror(errno));
+      }
+
+      data_ = static_cast<const char*>(ptr);
+      size_ = buf.st_size;
+   }
+
+   // The mapping stays valid after the descriptor is closed
+   close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+   if (data_)
+      munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
@@ -22,18 +22,46 @@
 #include "ILogger.hpp"
 #include "OpenGLHelper.hpp"
 #include "Matrix.hpp"
+#include "IConfig.hpp"
 
 #include <vector>
 #include <stdexcept>
+#include <unordered_map>
+#include <ostream>
+#include <cstring>
 
 #include <boost/cast.hpp>
 #include <boost/static_assert.hpp>
+#include <boost/cstdint.hpp>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 using namespace boost;
 
 namespace {
    int frame_counter = 0;
    int triangle_count = 0;
+   size_t vertex_memory_used = 0;
+   size_t vertex_memory_saved = 0;
+
+   // Vertex positions are hashed into cells a few times larger than
+   // the equality tolerance so most lookups only probe a single cell
+   const float WELD_CELL_SIZE = 4.0f * EqTolerance<float>::Value;
+
+   inline int weld_cell(float f)
+   {
+      return static_cast<int>(floorf(f / WELD_CELL_SIZE));
+   }
+
+   inline uint64_t weld_key(int x, int y, int z)
+   {
+      const uint64_t mask = (1 << 21) - 1;
+      return (uint64_t(x) & mask)
+         | ((uint64_t(y) & mask) << 21)
+         | ((uint64_t(z) & mask) << 42);
+   }
 }
 
 // Concrete implementation of mesh buffers
@@ -43,12 +71,25 @@ struct MeshBuffer : IMeshBuffer {
 
    // A chunk is a subset of the mesh bound to a particular texture
    struct Chunk {
+      Chunk() : welded(0) {}
+
+      bool find_duplicate(const Vertex& vertex, const Normal& normal,
+                          const Colour& colour, const TexCoord& tex_coord,
+                          Index& index);
+      void weld_new_vertices();
+
       vector<Vertex> vertices;
       vector<Normal> normals;
       vector<Colour> colours;
       vector<Index> indices;
       vector<TexCoord> tex_coords;
       ITexturePtr texture;
+
+      // Spatial hash of vertex positions used to find duplicates
+      // Vertices are entered lazily so merging is not slowed down
+      typedef unordered_multimap<uint64_t, Index> WeldIndex;
+      WeldIndex weld_index;
+      size_t welded;
    };
    typedef std::shared_ptr<Chunk> ChunkPtr;
 
@@ -70,6 +111,7 @@ struct MeshBuffer : IMeshBuffer {
    void merge(IMeshBufferPtr other, Vector<float> off, float y_angle);
 
    void print_stats() const;
+   void write(ostream& os) const;
 
    ChunkPtr find_chunk(ITexturePtr tex) const;
 
@@ -140,10 +182,92 @@ MeshBuffer::ChunkPtr MeshBuffer::find_chunk(ITexturePtr tex) const
    return ChunkPtr();
 }
 
+// Rotate a block of vertices and normals about the Y axis then translate
+// the vertices: the SSE path transposes four vertices at a time into
+// separate x, y, and z registers and transforms them together
+static void transform_vertices(const IMeshBuffer::Vertex* vertices,
+                               const IMeshBuffer::Normal* normals,
+                               size_t count,
+                               float cos_a, float sin_a,
+                               const Vector<float>& off,
+                               IMeshBuffer::Vertex* out_vertices,
+                               IMeshBuffer::Normal* out_normals)
+{
+   size_t i = 0;
+
+#ifdef __SSE__
+   typedef Packed<float, 4>::Type Float4;
+
+   const Float4 c = _mm_set1_ps(cos_a);
+   const Float4 s = _mm_set1_ps(sin_a);
+   const Float4 ox = _mm_set1_ps(off.x);
+   const Float4 oy = _mm_set1_ps(off.y);
+   const Float4 oz = _mm_set1_ps(off.z);
+   const Float4 one = _mm_set1_ps(1.0f);
+
+   for (; i + 4 <= count; i += 4) {
+      __m128 x = vertices[i].packed, y = vertices[i + 1].packed;
+      __m128 z = vertices[i + 2].packed, w = vertices[i + 3].packed;
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      __m128 vx = c * x + s * z + ox;
+      __m128 vy = y + oy;
+      __m128 vz = c * z - s * x + oz;
+      __m128 vw = one;
+      _MM_TRANSPOSE4_PS(vx, vy, vz, vw);
+
+      out_vertices[i].packed = vx;
+      out_vertices[i + 1].packed = vy;
+      out_vertices[i + 2].packed = vz;
+      out_vertices[i + 3].packed = vw;
+
+      x = normals[i].packed;
+      y = normals[i + 1].packed;
+      z = normals[i + 2].packed;
+      w = normals[i + 3].packed;
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      __m128 nx = c * x + s * z;
+      __m128 ny = y;
+      __m128 nz = c * z - s * x;
+      __m128 len = _mm_sqrt_ps(nx * nx + ny * ny + nz * nz);
+      nx /= len;
+      ny /= len;
+      nz /= len;
+
+      __m128 nw = one;
+      _MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+
+      out_normals[i].packed = nx;
+      out_normals[i + 1].packed = ny;
+      out_normals[i + 2].packed = nz;
+      out_normals[i + 3].packed = nw;
+   }
+#endif
+
+   for (; i < count; i++) {
+      const Vector<float>& v = vertices[i];
+      const Vector<float>& n = normals[i];
+
+      out_vertices[i] = make_vector(cos_a * v.x + sin_a * v.z + off.x,
+                                    v.y + off.y,
+                                    cos_a * v.z - sin_a * v.x + off.z);
+
+      out_normals[i] = make_vector(cos_a * n.x + sin_a * n.z,
+                                   n.y,
+                                   cos_a * n.z - sin_a * n.x).normalise();
+   }
+}
+
 void MeshBuffer::merge(IMeshBufferPtr other, Vector<float> off, float y_angle)
 {
    const MeshBuffer& obuf = dynamic_cast<const MeshBuffer&>(*other);
 
+   // Same rotation as MatrixF4::rotation about AXIS_Y
+   const float a = deg_to_rad(y_angle);
+   const float cos_a = cosf(a);
+   const float sin_a = sinf(a);
+
    for (vector<ChunkPtr>::const_iterator it = obuf.chunks.begin();
         it != obuf.chunks.end(); ++it) {
 
@@ -155,32 +279,34 @@ void MeshBuffer::merge(IMeshBufferPtr other, Vector<float> off, float y_angle)
          chunks.push_back(target_chunk);
       }
 
+      const Chunk& source = **it;
       const size_t ibase = target_chunk->vertices.size();
+      const size_t count = source.vertices.size();
 
-      const MatrixF4 translate = MatrixF4::translation(off.x, off.y, off.z);
-      const MatrixF4 rotate = MatrixF4::rotation(y_angle, MatrixF4::AXIS_Y);
+      target_chunk->vertices.resize(ibase + count);
+      target_chunk->normals.resize(ibase + count);
 
-      const MatrixF4 compose = translate * rotate;
+      if (count > 0)
+         transform_vertices(&source.vertices[0], &source.normals[0], count,
+                            cos_a, sin_a, off,
+                            &target_chunk->vertices[ibase],
+                            &target_chunk->normals[ibase]);
 
-      for (size_t i = 0; i < (*it)->vertices.size(); i++) {
-         const Vertex& v = (*it)->vertices[i];
-         const Normal& n = (*it)->normals[i];
+      target_chunk->tex_coords.insert(target_chunk->tex_coords.end(),
+                                      source.tex_coords.begin(),
+                                      source.tex_coords.end());
+      target_chunk->colours.insert(target_chunk->colours.end(),
+                                   source.colours.begin(),
+                                   source.colours.end());
 
-         target_chunk->vertices.push_back(compose.transform(v));
-         target_chunk->normals.push_back(rotate.transform(n).normalise());
+      target_chunk->indices.reserve(target_chunk->indices.size()
+                                    + source.indices.size());
 
-         const TexCoord& tc = (*it)->tex_coords[i];
-         target_chunk->tex_coords.push_back(tc);
-
-         const Colour& c = (*it)->colours[i];
-         target_chunk->colours.push_back(c);
-      }
-
-      for (size_t i = 0; i < (*it)->indices.size(); i++) {
-         Index orig = (*it)->indices[i];
+      for (size_t i = 0; i < source.indices.size(); i++) {
+         Index orig = source.indices[i];
          Index merged = orig + ibase;
 
-         assert(orig < (*it)->vertices.size());
+         assert(orig < source.vertices.size());
          assert(merged < target_chunk->vertices.size());
 
          target_chunk->indices.push_back(merged);
@@ -197,6 +323,55 @@ void MeshBuffer::print_stats() const
            << chunks.size() << " chunks";
 }
 
+template <class T>
+static void write_array(ostream& os, const vector<T>& v)
+{
+   if (!v.empty())
+      os.write(reinterpret_cast<const char*>(&v[0]), sizeof(T) * v.size());
+}
+
+template <class T>
+static void read_array(const char*& data, const char* end,
+                       vector<T>& v, size_t count)
+{
+   if (count > size_t(end - data) / sizeof(T))
+      throw runtime_error("Mesh buffer data is truncated");
+
+   // Copied rather than used in place as vertices must be aligned
+   v.resize(count);
+   if (count > 0)
+      memcpy(&v[0], data, sizeof(T) * count);
+   data += sizeof(T) * count;
+}
+
+// Binary format is the number of chunks followed by each chunk as
+// its vertex and index counts then the raw arrays in native layout
+void MeshBuffer::write(ostream& os) const
+{
+   const uint32_t n_chunks = chunks.size();
+   os.write(reinterpret_cast<const char*>(&n_chunks), sizeof(uint32_t));
+
+   for (vector<ChunkPtr>::const_iterator it = chunks.begin();
+        it != chunks.end(); ++it) {
+      const Chunk& c = **it;
+
+      if (c.texture)
+         throw runtime_error("Cannot write a textured mesh buffer");
+
+      const uint32_t counts[2] = {
+         static_cast<uint32_t>(c.vertices.size()),
+         static_cast<uint32_t>(c.indices.size())
+      };
+      os.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+
+      write_array(os, c.vertices);
+      write_array(os, c.normals);
+      write_array(os, c.colours);
+      write_array(os, c.tex_coords);
+      write_array(os, c.indices);
+   }
+}
+
 void MeshBuffer::add(const Vertex& vertex,
                      const Normal& normal,
                      const Colour& colour,
@@ -208,25 +383,12 @@ void MeshBuffer::add(const Vertex& vertex,
    }
 
    // See if this vertex has already been added
-   for (auto& it : active_chunk->indices) {
-      if (vertex == active_chunk->vertices[it]
-          && normal ==  active_chunk->normals[it]) {
-
-	 const TexCoord& tc = active_chunk->tex_coords[it];
-         const bool same_tc = (approx_equal(tc.x, a_tex_coord.x)
-                               && approx_equal(tc.y, a_tex_coord.y));
-
-         const Colour& c = active_chunk->colours[it];
-	 const bool same_col = (approx_equal(c.r, colour.r)
-                                && approx_equal(c.g, colour.g)
-                                && approx_equal(c.b, colour.b));
-
-         if (same_col && same_tc) {
-            active_chunk->indices.push_back(it);
-	    reused++;
-	    return;
-         }
-      }
+   Index dup;
+   if (active_chunk->find_duplicate(vertex, normal, colour,
+                                    a_tex_coord, dup)) {
+      active_chunk->indices.push_back(dup);
+      reused++;
+      return;
    }
 
    const size_t index = active_chunk->vertices.size();
@@ -237,6 +399,75 @@ void MeshBuffer::add(const Vertex& vertex,
    active_chunk->indices.push_back(index);
 }
 
+// Enter any vertices added since the last lookup into the weld index
+void MeshBuffer::Chunk::weld_new_vertices()
+{
+   for (; welded < vertices.size(); welded++) {
+      const Vertex& v = vertices[welded];
+      const uint64_t key = weld_key(weld_cell(v.x), weld_cell(v.y),
+                                    weld_cell(v.z));
+      weld_index.insert(make_pair(key, static_cast<Index>(welded)));
+   }
+}
+
+// Find an existing vertex equal to this one within the tolerance of
+// approx_equal: the lowest matching index is returned
+bool MeshBuffer::Chunk::find_duplicate(const Vertex& vertex,
+                                       const Normal& normal,
+                                       const Colour& colour,
+                                       const TexCoord& tex_coord,
+                                       Index& index)
+{
+   weld_new_vertices();
+
+   const float tol = EqTolerance<float>::Value;
+
+   // A match may lie in the neighbouring cell if the vertex is
+   // within tolerance of a cell boundary
+   const int xs[2] = { weld_cell(vertex.x - tol), weld_cell(vertex.x + tol) };
+   const int ys[2] = { weld_cell(vertex.y - tol), weld_cell(vertex.y + tol) };
+   const int zs[2] = { weld_cell(vertex.z - tol), weld_cell(vertex.z + tol) };
+
+   bool found = false;
+
+   for (int i = 0; i < (xs[0] == xs[1] ? 1 : 2); i++) {
+      for (int j = 0; j < (ys[0] == ys[1] ? 1 : 2); j++) {
+         for (int k = 0; k < (zs[0] == zs[1] ? 1 : 2); k++) {
+            pair<WeldIndex::const_iterator, WeldIndex::const_iterator> range =
+               weld_index.equal_range(weld_key(xs[i], ys[j], zs[k]));
+
+            for (WeldIndex::const_iterator it = range.first;
+                 it != range.second; ++it) {
+               const Index candidate = (*it).second;
+
+               if (found && candidate >= index)
+                  continue;
+
+               if (!(vertex == vertices[candidate]
+                     && normal == normals[candidate]))
+                  continue;
+
+               const TexCoord& tc = tex_coords[candidate];
+               const bool same_tc = (approx_equal(tc.x, tex_coord.x)
+                                     && approx_equal(tc.y, tex_coord.y));
+
+               const Colour& c = colours[candidate];
+               const bool same_col = (approx_equal(c.r, colour.r)
+                                      && approx_equal(c.g, colour.g)
+                                      && approx_equal(c.b, colour.b));
+
+               if (same_col && same_tc) {
+                  index = candidate;
+                  found = true;
+               }
+            }
+         }
+      }
+   }
+
+   return found;
+}
+
 void MeshBuffer::add_quad(Vertex a, Vertex b, Vertex c,
                           Vertex d, Colour colour)
 {
@@ -276,36 +507,118 @@ struct VertexData {
    float tx, ty;
    float r, g, b;
    float padding[5];   // Best performance on some cards if 32-byte aligned
+
+   void pack(const MeshBuffer::Chunk& chunk, size_t i);
+   static void set_pointers(const GLubyte* base);
 };
 
 BOOST_STATIC_ASSERT(sizeof(VertexData) == 64);
 
-// Get the vertex data out of a mesh buffer into a VertexData array
-static void copy_vertex_data(const MeshBuffer* buf, VertexData* vertex_data)
+void VertexData::pack(const MeshBuffer::Chunk& chunk, size_t i)
 {
-   size_t offset = 0;
+   x = chunk.vertices[i].x;
+   y = chunk.vertices[i].y;
+   z = chunk.vertices[i].z;
 
-   for (auto& chunk : buf->chunks) {
-      for (size_t i = 0; i < chunk->vertices.size(); i++) {
-         VertexData* vd = &vertex_data[offset + i];
+   nx = chunk.normals[i].x;
+   ny = chunk.normals[i].y;
+   nz = chunk.normals[i].z;
 
-         vd->x = chunk->vertices[i].x;
-         vd->y = chunk->vertices[i].y;
-         vd->z = chunk->vertices[i].z;
+   if (chunk.texture) {
+      tx = chunk.tex_coords[i].x;
+      ty = 1.0f - chunk.tex_coords[i].y;
+   }
 
-         vd->nx = chunk->normals[i].x;
-         vd->ny = chunk->normals[i].y;
-         vd->nz = chunk->normals[i].z;
+   r = chunk.colours[i].r;
+   g = chunk.colours[i].g;
+   b = chunk.colours[i].b;
+}
 
-         if (chunk->texture) {
-            vd->tx = chunk->tex_coords[i].x;
-            vd->ty = 1.0f - chunk->tex_coords[i].y;
-         }
+// Base is NULL for VBOs as pointers are relative to the buffer start
+void VertexData::set_pointers(const GLubyte* base)
+{
+   glColorPointer(3, GL_FLOAT, sizeof(VertexData),
+                  base + offsetof(VertexData, r));
+   glNormalPointer(GL_FLOAT, sizeof(VertexData),
+                   base + offsetof(VertexData, nx));
+   glVertexPointer(3, GL_FLOAT, sizeof(VertexData),
+                   base + offsetof(VertexData, x));
+   glTexCoordPointer(2, GL_FLOAT, sizeof(VertexData),
+                     base + offsetof(VertexData, tx));
+}
 
-         vd->r = chunk->colours[i].r;
-         vd->g = chunk->colours[i].g;
-         vd->b = chunk->colours[i].b;
-      }
+// Compact alternative to VertexData: normals are signed 16-bit fixed
+// point and colours one byte per channel, which OpenGL normalises
+// Texture coordinates stay as floats because terrain coordinates run
+// well outside [0, 1] and glTexCoordPointer does not normalise integers
+struct PackedVertexData {
+   float x, y, z;
+   GLshort nx, ny, nz, npad;
+   float tx, ty;
+   GLubyte r, g, b, a;
+
+   void pack(const MeshBuffer::Chunk& chunk, size_t i);
+   static void set_pointers(const GLubyte* base);
+};
+
+BOOST_STATIC_ASSERT(sizeof(PackedVertexData) == 32);
+
+static inline GLshort pack_snorm16(float f)
+{
+   return static_cast<GLshort>(floorf(max(-1.0f, min(1.0f, f)) * 32767.0f
+                                      + 0.5f));
+}
+
+static inline GLubyte pack_unorm8(float f)
+{
+   return static_cast<GLubyte>(max(0.0f, min(1.0f, f)) * 255.0f + 0.5f);
+}
+
+void PackedVertexData::pack(const MeshBuffer::Chunk& chunk, size_t i)
+{
+   x = chunk.vertices[i].x;
+   y = chunk.vertices[i].y;
+   z = chunk.vertices[i].z;
+
+   nx = pack_snorm16(chunk.normals[i].x);
+   ny = pack_snorm16(chunk.normals[i].y);
+   nz = pack_snorm16(chunk.normals[i].z);
+   npad = 0;
+
+   if (chunk.texture) {
+      tx = chunk.tex_coords[i].x;
+      ty = 1.0f - chunk.tex_coords[i].y;
+   }
+   else
+      tx = ty = 0.0f;
+
+   r = pack_unorm8(chunk.colours[i].r);
+   g = pack_unorm8(chunk.colours[i].g);
+   b = pack_unorm8(chunk.colours[i].b);
+   a = 255;
+}
+
+void PackedVertexData::set_pointers(const GLubyte* base)
+{
+   glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(PackedVertexData),
+                  base + offsetof(PackedVertexData, r));
+   glNormalPointer(GL_SHORT, sizeof(PackedVertexData),
+                   base + offsetof(PackedVertexData, nx));
+   glVertexPointer(3, GL_FLOAT, sizeof(PackedVertexData),
+                   base + offsetof(PackedVertexData, x));
+   glTexCoordPointer(2, GL_FLOAT, sizeof(PackedVertexData),
+                     base + offsetof(PackedVertexData, tx));
+}
+
+// Get the vertex data out of a mesh buffer into a VertexData array
+template <class T>
+static void copy_vertex_data(const MeshBuffer* buf, T* vertex_data)
+{
+   size_t offset = 0;
+
+   for (auto& chunk : buf->chunks) {
+      for (size_t i = 0; i < chunk->vertices.size(); i++)
+         vertex_data[offset + i].pack(*chunk, i);
 
       offset += chunk->vertices.size();
    }
@@ -315,38 +628,59 @@ static void copy_vertex_data(const MeshBuffer* buf, VertexData* vertex_data)
 struct ChunkDelim {
    ITexturePtr texture;
    GLsizei min, max;
-   size_t offset, count;
+   size_t offset, count;   // Offset is in bytes
+   GLenum type;            // Either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
 };
 
-static void copy_index_data(const MeshBuffer *buf,
-                            vector<ChunkDelim>& delims,
-                            GLushort *index_data)
+// Largest vertex number that can be addressed by a 16-bit index
+static const size_t MAX_SHORT_INDEX = 0xffff;
+
+template <class T>
+static void append_indices(const MeshBuffer::Chunk& chunk, size_t base,
+                           vector<GLubyte>& index_data)
 {
-   size_t global_idx = 0;
-   GLushort offset = 0;
+   if (chunk.indices.empty())
+      return;
 
-   vector<MeshBuffer::ChunkPtr>::const_iterator chunk_it;
+   const size_t start = index_data.size();
+   index_data.resize(start + chunk.indices.size() * sizeof(T));
 
-   for (chunk_it = buf->chunks.begin();
-        chunk_it != buf->chunks.end(); ++chunk_it) {
+   T* p = reinterpret_cast<T*>(&index_data[start]);
+   for (auto& i : chunk.indices)
+      *p++ = static_cast<T>(i + base);
+}
 
-      ChunkDelim delim;
-      delim.texture = (*chunk_it)->texture;
-      delim.count = (*chunk_it)->indices.size();
-      delim.offset = global_idx;
+// Chunks which only reference vertices up to MAX_SHORT_INDEX get
+// 16-bit indices and the remainder 32-bit indices so large meshes
+// are drawn correctly while small meshes keep the compact format
+static void copy_index_data(const MeshBuffer *buf,
+                            vector<ChunkDelim>& delims,
+                            vector<GLubyte>& index_data)
+{
+   size_t offset = 0;
 
-      vector<IMeshBuffer::Index>::const_iterator it;
-      for (it = (*chunk_it)->indices.begin();
-           it != (*chunk_it)->indices.end(); ++it) {
+   for (auto& chunk : buf->chunks) {
+      ChunkDelim delim;
+      delim.texture = chunk->texture;
+      delim.count = chunk->indices.size();
+      delim.min = offset;
+      delim.max = offset + chunk->vertices.size() - 1;
 
-         index_data[global_idx++] = *it + offset;
+      if (offset + chunk->vertices.size() <= MAX_SHORT_INDEX + 1) {
+         delim.type = GL_UNSIGNED_SHORT;
+         delim.offset = index_data.size();
+         append_indices<GLushort>(*chunk, offset, index_data);
       }
+      else {
+         // Keep the 32-bit indices aligned
+         index_data.resize((index_data.size() + 3) & ~3);
 
-      delim.min = offset;
-
-      offset += (*chunk_it)->vertices.size();
+         delim.type = GL_UNSIGNED_INT;
+         delim.offset = index_data.size();
+         append_indices<GLuint>(*chunk, offset, index_data);
+      }
 
-      delim.max = offset - 1;
+      offset += chunk->vertices.size();
 
       delims.push_back(delim);
    }
@@ -363,8 +697,7 @@ public:
 private:
    size_t my_vertex_count;
    VertexData* my_vertex_data;
-   size_t my_index_count;
-   GLushort* my_indices;
+   vector<GLubyte> my_indices;
    vector<ChunkDelim> chunks;
 };
 
@@ -372,9 +705,6 @@ VertexArrayMesh::VertexArrayMesh(IMeshBufferPtr a_buffer)
 {
    const MeshBuffer* buf = MeshBuffer::get(a_buffer);
 
-   my_index_count = buf->index_count();
-   my_indices = new GLushort[my_index_count];
-
    my_vertex_count = buf->vertex_count();
    my_vertex_data = new VertexData[my_vertex_count];
 
@@ -385,7 +715,6 @@ VertexArrayMesh::VertexArrayMesh(IMeshBufferPtr a_buffer)
 VertexArrayMesh::~VertexArrayMesh()
 {
    delete[] my_vertex_data;
-   delete[] my_indices;
 }
 
 void VertexArrayMesh::render() const
@@ -400,23 +729,18 @@ void VertexArrayMesh::render() const
        glDisable(GL_BLEND);
 
    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-   glTexCoordPointer(2, GL_FLOAT, sizeof(VertexData),
-                     reinterpret_cast<GLvoid*>(&my_vertex_data->tx));
-
    glEnableClientState(GL_COLOR_ARRAY);
-   glColorPointer(3, GL_FLOAT, sizeof(VertexData),
-                  reinterpret_cast<GLvoid*>(&my_vertex_data->r));
-
    glEnableClientState(GL_VERTEX_ARRAY);
    glEnableClientState(GL_NORMAL_ARRAY);
-   glVertexPointer(3, GL_FLOAT, sizeof(VertexData),
-                   reinterpret_cast<GLvoid*>(my_vertex_data));
-   glNormalPointer(GL_FLOAT, sizeof(VertexData),
-                   reinterpret_cast<GLvoid*>(&my_vertex_data->nx));
+
+   VertexData::set_pointers(reinterpret_cast<GLubyte*>(my_vertex_data));
 
    glEnable(GL_COLOR_MATERIAL);
 
    for (auto& delim : chunks) {
+      if (delim.count == 0)
+         continue;
+
       if (delim.texture) {
          glEnable(GL_TEXTURE_2D);
          delim.texture->bind();
@@ -430,8 +754,8 @@ void VertexArrayMesh::render() const
                           delim.min,
                           delim.max,
                           delim.count,
-                          GL_UNSIGNED_SHORT,
-                          my_indices + delim.offset);
+                          delim.type,
+                          &my_indices[delim.offset]);
    }
 
    glPopClientAttrib();
@@ -439,6 +763,7 @@ void VertexArrayMesh::render() const
 }
 
 // Implementation of meshes using server side VBOs
+template <class T>
 class VBOMesh : public IMesh {
 public:
    VBOMesh(IMeshBufferPtr a_buffer);
@@ -447,58 +772,67 @@ public:
    void render() const;
 private:
    GLuint vbo_buf, index_buf;
-   size_t index_count;
+   size_t vertex_count, index_count;
    vector<ChunkDelim> chunks;
 };
 
-VBOMesh::VBOMesh(IMeshBufferPtr a_buffer)
+template <class T>
+VBOMesh<T>::VBOMesh(IMeshBufferPtr a_buffer)
 {
    // Get the data out of the buffer;
    const MeshBuffer* buf = MeshBuffer::get(a_buffer);
 
-   const size_t vertex_count = buf->vertex_count();
-   VertexData* p_vertex_data = new VertexData[vertex_count];
+   vertex_count = buf->vertex_count();
+   T* p_vertex_data = new T[vertex_count];
 
    copy_vertex_data(buf, p_vertex_data);
 
    // Generate the VBO
    glGenBuffersARB(1, &vbo_buf);
    glBindBufferARB(GL_ARRAY_BUFFER, vbo_buf);
-   glBufferDataARB(GL_ARRAY_BUFFER, vertex_count * sizeof(VertexData),
+   glBufferDataARB(GL_ARRAY_BUFFER, vertex_count * sizeof(T),
       NULL, GL_STATIC_DRAW);
 
    // Copy the vertex data in
    glBufferSubDataARB(GL_ARRAY_BUFFER, 0,
-      vertex_count * sizeof(VertexData), p_vertex_data);
+      vertex_count * sizeof(T), p_vertex_data);
 
    // Copy the indices into a temporary array
    index_count = buf->index_count();
-   GLushort* p_indices = new GLushort[index_count];
+   vector<GLubyte> index_data;
 
-   copy_index_data(buf, chunks, p_indices);
+   copy_index_data(buf, chunks, index_data);
 
    // Build the index buffer
    glGenBuffersARB(1, &index_buf);
    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, index_buf);
-   glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(GLushort),
+   glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, index_data.size(),
       NULL, GL_STATIC_DRAW);
-   glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER, 0,
-      index_count * sizeof(GLushort), p_indices);
+   if (!index_data.empty())
+      glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER, 0,
+         index_data.size(), &index_data[0]);
 
    glBindBufferARB(GL_ARRAY_BUFFER, 0);
    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
 
    delete[] p_vertex_data;
-   delete[] p_indices;
+
+   ::vertex_memory_used += vertex_count * sizeof(T);
+   ::vertex_memory_saved += vertex_count * (sizeof(VertexData) - sizeof(T));
 }
 
-VBOMesh::~VBOMesh()
+template <class T>
+VBOMesh<T>::~VBOMesh()
 {
    glDeleteBuffersARB(1, &vbo_buf);
    glDeleteBuffersARB(1, &index_buf);
+
+   ::vertex_memory_used -= vertex_count * sizeof(T);
+   ::vertex_memory_saved -= vertex_count * (sizeof(VertexData) - sizeof(T));
 }
 
-void VBOMesh::render() const
+template <class T>
+void VBOMesh<T>::render() const
 {
    glPushAttrib(GL_ENABLE_BIT);
    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
@@ -516,21 +850,12 @@ void VBOMesh::render() const
       glDisable(GL_BLEND);
 
    glEnableClientState(GL_COLOR_ARRAY);
-   glColorPointer(3, GL_FLOAT, sizeof(VertexData),
-                  reinterpret_cast<GLvoid*>(offsetof(VertexData, r)));
-
    glEnableClientState(GL_VERTEX_ARRAY);
    glEnableClientState(GL_NORMAL_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
    // Pointers are relative to start of VBO
-   glNormalPointer(GL_FLOAT, sizeof(VertexData),
-      reinterpret_cast<GLvoid*>(offsetof(VertexData, nx)));
-   glVertexPointer(3, GL_FLOAT, sizeof(VertexData),
-      reinterpret_cast<GLvoid*>(0));
-
-   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-   glTexCoordPointer(2, GL_FLOAT, sizeof(VertexData),
-                     reinterpret_cast<GLvoid*>(offsetof(VertexData, tx)));
+   T::set_pointers(NULL);
 
    for (auto& delim : chunks) {
       if (delim.count == 0)
@@ -544,14 +869,12 @@ void VBOMesh::render() const
          glDisable(GL_TEXTURE_2D);
       }
 
-      const size_t offset_ptr = delim.offset * sizeof(GLushort);
-
       glDrawRangeElements(GL_TRIANGLES,
                           delim.min,
                           delim.max,
                           delim.count,
-                          GL_UNSIGNED_SHORT,
-                          reinterpret_cast<GLvoid*>(offset_ptr));
+                          delim.type,
+                          reinterpret_cast<GLvoid*>(delim.offset));
    }
 
    glPopClientAttrib();
@@ -564,9 +887,15 @@ IMeshPtr make_mesh(IMeshBufferPtr buffer)
 {
    //buffer->print_stats();
 
+   static const bool packed = get_config()->get<bool>("PackedVertices");
+
    // Prefer VBOs for all meshes
-   if (GLEW_ARB_vertex_buffer_object)
-      return IMeshPtr(new VBOMesh(buffer));
+   if (GLEW_ARB_vertex_buffer_object) {
+      if (packed)
+         return IMeshPtr(new VBOMesh<PackedVertexData>(buffer));
+      else
+         return IMeshPtr(new VBOMesh<VertexData>(buffer));
+   }
    else
       return IMeshPtr(new VertexArrayMesh(buffer));
 }
@@ -576,6 +905,41 @@ IMeshBufferPtr make_mesh_buffer()
    return IMeshBufferPtr(new MeshBuffer);
 }
 
+IMeshBufferPtr read_mesh_buffer(const char* data, size_t size)
+{
+   const char* end = data + size;
+
+   vector<uint32_t> n_chunks;
+   read_array(data, end, n_chunks, 1);
+
+   MeshBuffer* buf = new MeshBuffer;
+   IMeshBufferPtr ptr(buf);
+
+   for (uint32_t i = 0; i < n_chunks[0]; i++) {
+      vector<uint32_t> counts;
+      read_array(data, end, counts, 2);
+
+      MeshBuffer::ChunkPtr c(new MeshBuffer::Chunk);
+      read_array(data, end, c->vertices, counts[0]);
+      read_array(data, end, c->normals, counts[0]);
+      read_array(data, end, c->colours, counts[0]);
+      read_array(data, end, c->tex_coords, counts[0]);
+      read_array(data, end, c->indices, counts[1]);
+
+      for (size_t j = 0; j < c->indices.size(); j++) {
+         if (c->indices[j] >= counts[0])
+            throw runtime_error("Mesh buffer index out of range");
+      }
+
+      buf->chunks.push_back(c);
+   }
+
+   if (data != end)
+      throw runtime_error("Mesh buffer has trailing data");
+
+   return ptr;
+}
+
 void update_render_stats()
 {
    ::frame_counter++;
@@ -591,3 +955,13 @@ int get_average_triangle_count()
       return avg;
    }
 }
+
+size_t get_vertex_memory_used()
+{
+   return ::vertex_memory_used;
+}
+
+size_t get_vertex_memory_saved()
+{
+   return ::vertex_memory_saved;
+}
@@ -21,6 +21,8 @@
 #include "ILogger.hpp"
 #include "IMesh.hpp"
 #include "ResourceCache.hpp"
+#include "MappedFile.hpp"
+#include "Paths.hpp"
 
 #include <string>
 #include <fstream>
@@ -31,13 +33,37 @@
 #include <algorithm>
 #include <map>
 #include <list>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <future>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/cstdint.hpp>
 
 // Cache of already loaded models
 namespace {
-   typedef map<string, IModelPtr> ModelCache;
+   typedef shared_future<IModelPtr> ModelFuture;
+   typedef map<string, ModelFuture> ModelCache;
    ModelCache the_cache;
+   mutex cache_mutex;
+
+   // Parsed models are also saved under the cache directory as a
+   // header, the key and material file name, then the mesh buffer
+   const char CACHE_MAGIC[4] = { 'T', 'G', 'M', 'C' };
+   const int32_t CACHE_VERSION = 1;
+
+   struct CacheHeader {
+      char magic[4];
+      int32_t version;
+      float dim[3];
+      int32_t key_size;
+      int32_t mtl_size;
+      int32_t pad;        // Aligns mtl_time
+      int64_t mtl_time;   // Modification time of the material file
+   };
 }
 
 struct Material {
@@ -176,23 +202,195 @@ void Model::compile_mesh() const
    mesh = make_mesh(buffer);
 }
 
-// Load a model from a resource
-IModelPtr load_model(IResourcePtr a_res,
-                     const string& a_file_name,
-                     float a_scale,
-                     Vector<float> shift)
+// Reads the text of a mapped OBJ file in place: words are returned as
+// pointers into the file and numbers are converted without copying
+class ObjScanner {
+public:
+   ObjScanner(const MappedFile& file)
+      : p(file.data()), end(file.data() + file.size()),
+        file_name(file.file_name()), line(1) {}
+
+   // A word which is only valid while the file is mapped
+   struct Word {
+      const char* text;
+      size_t len;
+
+      bool operator==(const char* s) const
+      {
+         return strlen(s) == len && memcmp(text, s, len) == 0;
+      }
+
+      string str() const { return string(text, len); }
+   };
+
+   bool at_end() const { return p == end; }
+
+   bool at_line_end()
+   {
+      skip_blanks();
+      return p == end || *p == '\n';
+   }
+
+   void next_line()
+   {
+      const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+      p = nl ? nl + 1 : end;
+      line++;
+   }
+
+   Word word()
+   {
+      skip_blanks();
+
+      Word w = { p, 0 };
+      while (p != end && !is_blank(*p) && *p != '\n')
+         ++p;
+      w.len = p - w.text;
+      return w;
+   }
+
+   bool next_is(char c) const { return p != end && *p == c; }
+
+   void expect(char c)
+   {
+      if (!next_is(c))
+         fail(string("expected '") + c + "'");
+      ++p;
+   }
+
+   float number();
+   unsigned index();
+
+   void fail(const string& what) const
+   {
+      ostringstream ss;
+      ss << file_name << ":" << line << ": " << what;
+      throw runtime_error(ss.str());
+   }
+
+private:
+   static bool is_blank(char c)
+   {
+      return c == ' ' || c == '\t' || c == '\r';
+   }
+
+   static bool is_digit(char c)
+   {
+      return c >= '0' && c <= '9';
+   }
+
+   void skip_blanks()
+   {
+      while (p != end && is_blank(*p))
+         ++p;
+   }
+
+   const char* p;
+   const char* const end;
+   const string& file_name;
+   int line;
+};
+
+// Up to 19 significant digits are accumulated in an integer which is
+// then scaled once by a power of ten: much faster than strtod and
+// exact enough for the six or so digits exporters write
+float ObjScanner::number()
 {
-   // Make a unique cache name
-   const string cache_name = a_res->name() + ":" + a_file_name;
+   static const double powers[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+      1e21, 1e22
+   };
+   const int max_power = sizeof(powers) / sizeof(double) - 1;
+
+   skip_blanks();
+
+   bool negative = false;
+   if (p != end && (*p == '-' || *p == '+'))
+      negative = (*p++ == '-');
+
+   uint64_t mantissa = 0;
+   int significant = 0, exponent = 0;
+   bool any_digits = false;
+
+   for (; p != end && is_digit(*p); ++p) {
+      any_digits = true;
+      if (significant < 19) {
+         mantissa = mantissa * 10 + (*p - '0');
+         significant += (mantissa > 0);
+      }
+      else
+         exponent++;
+   }
 
-   // Check the cache for the model
-   ModelCache::iterator it = the_cache.find(cache_name);
-   if (it != the_cache.end())
-      return (*it).second;
+   if (p != end && *p == '.') {
+      for (++p; p != end && is_digit(*p); ++p) {
+         any_digits = true;
+         if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            significant += (mantissa > 0);
+            exponent--;
+         }
+      }
+   }
 
-   // Not in the cache, load it from the resource
-   IResource::Handle h = a_res->open_file(a_file_name);
-   log() << "Loading model " << h.file_name();
+   if (!any_digits)
+      fail("expected a number");
+
+   if (p != end && (*p == 'e' || *p == 'E')) {
+      ++p;
+
+      bool negative_exp = false;
+      if (p != end && (*p == '-' || *p == '+'))
+         negative_exp = (*p++ == '-');
+
+      if (p == end || !is_digit(*p))
+         fail("bad exponent");
+
+      int e = 0;
+      for (; p != end && is_digit(*p); ++p)
+         e = min(e * 10 + (*p - '0'), 1000);
+
+      exponent += negative_exp ? -e : e;
+   }
+
+   double value = static_cast<double>(mantissa);
+   if (exponent < 0)
+      value /= (-exponent <= max_power
+                ? powers[-exponent] : pow(10.0, -exponent));
+   else if (exponent > 0)
+      value *= (exponent <= max_power
+                ? powers[exponent] : pow(10.0, exponent));
+
+   return static_cast<float>(negative ? -value : value);
+}
+
+// One based index in a face definition
+unsigned ObjScanner::index()
+{
+   if (p == end || !is_digit(*p))
+      fail("expected an index");
+
+   unsigned i = 0;
+   for (; p != end && is_digit(*p); ++p)
+      i = i * 10 + (*p - '0');
+
+   return i;
+}
+
+// Parse a WaveFront OBJ file into a mesh buffer
+static IMeshBufferPtr parse_obj(IResourcePtr a_res,
+                                const boost::filesystem::path& file,
+                                float a_scale,
+                                Vector<float> shift,
+                                Vector<float>& dim,
+                                string& mtl_file)
+{
+   typedef chrono::steady_clock Clock;
+   const Clock::time_point start = Clock::now();
+
+   MappedFile mapped(file.string());
+   log() << "Loading model " << mapped.file_name();
 
    vector<IMeshBuffer::Vertex> vertices;
    vector<IMeshBuffer::Normal> normals;
@@ -208,32 +406,26 @@ IModelPtr load_model(IResourcePtr a_res,
    MaterialFilePtr material_file;
    Material active_mtl;
 
-   ifstream& f = h.rstream();
+   ObjScanner scan(mapped);
 
-   while (!f.eof()) {
-      string first;
-      f >> first;
+   for (; !scan.at_end(); scan.next_line()) {
+      const ObjScanner::Word first = scan.word();
 
-      if (first[0] == '#') {
-         // Comment
-      }
-      else if (first == "o") {
-         // New object
-         string obj_name;
-         f >> obj_name;
+      if (first.len == 0 || first.text[0] == '#') {
+         // Blank line or comment
       }
       else if (first == "mtllib") {
          // Material file
-         string file_name;
-         f >> file_name;
+         mtl_file = scan.word().str();
 
          material_file =
-            MaterialFilePtr(new MaterialFile(file_name, a_res));
+            MaterialFilePtr(new MaterialFile(mtl_file, a_res));
       }
       else if (first == "v") {
          // Vertex
-         float x, y, z;
-         f >> x >> y >> z;
+         float x = scan.number();
+         float y = scan.number();
+         float z = scan.number();
 
          x += shift.x;
          y += shift.y;
@@ -265,97 +457,291 @@ IModelPtr load_model(IResourcePtr a_res,
       }
       else if (first == "vn") {
          // Normal
-         float x, y, z;
-         f >> x >> y >> z;
+         const float x = scan.number();
+         const float y = scan.number();
+         const float z = scan.number();
 
          normals.push_back(make_vector(x, y, z));
       }
       else if (first == "vt") {
          // Texture coordinate
-         float x, y;
-         f >> x >> y;
+         const float x = scan.number();
+         const float y = scan.number();
 
          texture_offs.push_back(make_point(x, y));
       }
-      else if (first == "g") {
-         // Groups used to correspond to sub-meshes but now
-         // the whole model is compiled into a single mesh
-      }
       else if (first == "usemtl") {
          // Set the material for this group
-         string material_name;
-         f >> material_name;
+         const string material_name = scan.word().str();
 
-         if (material_file) {
-            assert(buffer);
+         if (material_file)
             active_mtl = material_file->get(material_name);
-         }
       }
       else if (first == "f") {
-         // Face
-         string line;
-         getline(f, line);
-         istringstream ss(line);
+         // Face of either v/vt/vn or v//vn vertices
+         const Colour col = make_colour(active_mtl.diffuseR,
+                                        active_mtl.diffuseG,
+                                        active_mtl.diffuseB);
 
-         int v_in_thisFace = 0;
+         int v_in_this_face = 0;
 
-         while (!ss.eof()) {
-            char delim1, delim2;
-            unsigned vi, vti, vni;
-            ss >> vi >> delim1;
-            if (ss.fail())
-               break;
-
-            if (++v_in_thisFace > 3)
-               warn () << "All model faces must be triangles "
-                       << "(face with " << v_in_thisFace << " vertices)";
+         while (!scan.at_line_end()) {
+            const unsigned vi = scan.index();
+            scan.expect('/');
 
             // Texture coordinate may be omitted
-            ss >> vti;
-            if (ss.fail()) {
-               vti = -1;
-               ss.clear();
-            }
+            unsigned vti = 0;
+            if (!scan.next_is('/'))
+               vti = scan.index();
 
-            ss >> delim2 >> vni;
-            assert(delim1 == '/' && delim2 == '/');
+            scan.expect('/');
+            const unsigned vni = scan.index();
 
-            Vector<float>& v = vertices[vi - 1];
-            Vector<float>& vn = normals[vni - 1];
+            if (vi < 1 || vi > vertices.size())
+               scan.fail("vertex index out of range");
+            else if (vni < 1 || vni > normals.size())
+               scan.fail("normal index out of range");
 
-            assert(buffer);
+            if (++v_in_this_face > 3)
+               warn () << "All model faces must be triangles "
+                       << "(face with " << v_in_this_face << " vertices)";
 
-            const Colour col = make_colour(active_mtl.diffuseR,
-                                           active_mtl.diffuseG,
-                                           active_mtl.diffuseB);
+            const Vector<float>& v = vertices[vi - 1];
+            const Vector<float>& vn = normals[vni - 1];
 
-            if (vti - 1 < texture_offs.size()) {
-               Point<float>& vt = texture_offs[vti - 1];
-               buffer->add(v, vn, col, vt);
-            }
+            if (vti >= 1 && vti <= texture_offs.size())
+               buffer->add(v, vn, col, texture_offs[vti - 1]);
             else
                buffer->add(v, vn, col);
          }
 
          face_count++;
-
-         // Don't discard the next line
-         continue;
       }
 
-      // Discard the rest of the line
-      getline(f, first);
+      // Anything else such as objects and groups is ignored: the whole
+      // model is compiled into a single mesh
    }
 
-   Vector<float> dim = make_vector(xmax - xmin, ymax - ymin, zmax - zmin);
+   dim = make_vector(xmax - xmin, ymax - ymin, zmax - zmin);
+
+   const chrono::duration<double> elapsed = Clock::now() - start;
+   const double mbytes = mapped.size() / (1024.0 * 1024.0);
 
    log() << "Model loaded: " << vertices.size() << " vertices, "
-         << face_count << " faces";
+         << face_count << " faces in " << elapsed.count() * 1000.0 << "ms"
+         << " (" << (elapsed.count() > 0.0 ? mbytes / elapsed.count() : 0.0)
+         << " MB/s)";
 
-   IModelPtr ptr(new Model(dim, buffer));
+   return buffer;
+}
 
-   the_cache[cache_name] = ptr;
-   return ptr;
+// Everything the parsed model depends on except the material file
+// which is checked separately as its name is only known after parsing
+static string model_cache_key(const boost::filesystem::path& file,
+                              float scale, Vector<float> shift)
+{
+   ostringstream ss;
+   ss.precision(9);
+   ss << file.string() << ":" << boost::filesystem::last_write_time(file)
+      << ":" << scale << ":" << shift.x << "," << shift.y << "," << shift.z;
+   return ss.str();
 }
 
+static boost::filesystem::path model_cache_name(const string& key)
+{
+   ostringstream ss;
+   ss << "model_" << hex << boost::hash<string>()(key) << ".dat";
+
+   return get_cache_dir() / ss.str();
+}
+
+// Returns a null pointer if there is no usable cached copy
+static IMeshBufferPtr load_cached_model(
+   const boost::filesystem::path& cache_file, const string& key,
+   const boost::filesystem::path& res_dir, Vector<float>& dim)
+{
+   using namespace boost::filesystem;
+
+   if (!exists(cache_file))
+      return IMeshBufferPtr();
+
+   try {
+      MappedFile file(cache_file.string());
+
+      CacheHeader header;
+      if (file.size() < sizeof(CacheHeader))
+         throw runtime_error("file is truncated");
+
+      memcpy(&header, file.data(), sizeof(CacheHeader));
+
+      if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+          || header.version != CACHE_VERSION)
+         throw runtime_error("wrong format version");
+
+      const char* p = file.data() + sizeof(CacheHeader);
+      const char* end = file.data() + file.size();
+
+      if (header.key_size < 0 || header.mtl_size < 0
+          || header.key_size + header.mtl_size > end - p)
+         throw runtime_error("file is truncated");
+
+      // Different key means a hash collision so just parse the model
+      if (string(p, header.key_size) != key)
+         return IMeshBufferPtr();
+      p += header.key_size;
+
+      const string mtl_file(p, header.mtl_size);
+      p += header.mtl_size;
+
+      if (!mtl_file.empty()) {
+         const path mtl_path = res_dir / mtl_file;
+         if (!exists(mtl_path)
+             || last_write_time(mtl_path) != header.mtl_time)
+            return IMeshBufferPtr();
+      }
+
+      dim = make_vector(header.dim[0], header.dim[1], header.dim[2]);
+      return read_mesh_buffer(p, end - p);
+   }
+   catch (runtime_error& e) {
+      warn() << "Ignoring cached model " << cache_file << ": " << e.what();
+      return IMeshBufferPtr();
+   }
+}
+
+static void save_cached_model(const boost::filesystem::path& cache_file,
+                              const string& key,
+                              const boost::filesystem::path& res_dir,
+                              const string& mtl_file,
+                              Vector<float> dim,
+                              IMeshBufferPtr buffer)
+{
+   const string fname = cache_file.string();
+
+   // Written under a temporary name and renamed into place as another
+   // process may have the old file mapped
+   const string tmp = fname + ".tmp";
+
+   CacheHeader header = {
+      { CACHE_MAGIC[0], CACHE_MAGIC[1], CACHE_MAGIC[2], CACHE_MAGIC[3] },
+      CACHE_VERSION,
+      { dim.x, dim.y, dim.z },
+      static_cast<int32_t>(key.size()),
+      static_cast<int32_t>(mtl_file.size()),
+      0,
+      mtl_file.empty() ? 0
+      : boost::filesystem::last_write_time(res_dir / mtl_file)
+   };
+
+   {
+      ofstream f;
+      f.open(tmp.c_str(), ios::out | ios::binary);
+      if (!f.is_open())
+         throw runtime_error("Failed to create " + tmp);
+
+      f.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+      f.write(key.data(), key.size());
+      f.write(mtl_file.data(), mtl_file.size());
+      buffer->write(f);
+
+      f.close();
+      if (f.fail()) {
+         boost::filesystem::remove(tmp);
+         throw runtime_error("Failed writing " + tmp);
+      }
+   }
+
+   boost::filesystem::rename(tmp, fname);
+}
+
+// Read a model from the disk cache or parse it from the resource
+static IModelPtr read_model(IResourcePtr a_res,
+                            const string& a_file_name,
+                            float a_scale,
+                            Vector<float> shift)
+{
+   using namespace boost::filesystem;
+
+   const path res_dir = path(a_res->xml_file_name()).parent_path();
+   const path file = res_dir / a_file_name;
 
+   // First check for a copy saved by a previous run
+   string key;
+   path cache_file;
+   IMeshBufferPtr buffer;
+   Vector<float> dim;
+
+   if (exists(file)) {
+      key = model_cache_key(file, a_scale, shift);
+      cache_file = model_cache_name(key);
+      buffer = load_cached_model(cache_file, key, res_dir, dim);
+
+      if (buffer)
+         log() << "Loaded cached model " << file << " from " << cache_file;
+   }
+
+   // Not in the disk cache, load it from the resource
+   if (!buffer) {
+      string mtl_file;
+      buffer = parse_obj(a_res, file, a_scale, shift, dim, mtl_file);
+
+      if (!key.empty()) {
+         try {
+            save_cached_model(cache_file, key, res_dir, mtl_file,
+                              dim, buffer);
+         }
+         catch (exception& e) {
+            warn() << "Failed to cache model: " << e.what();
+         }
+      }
+   }
+
+   return IModelPtr(new Model(dim, buffer));
+}
+
+// Load a model from a resource
+// This may be called from worker threads as the mesh is only compiled
+// when the model is first rendered
+IModelPtr load_model(IResourcePtr a_res,
+                     const string& a_file_name,
+                     float a_scale,
+                     Vector<float> shift)
+{
+   // Make a unique cache name
+   const string cache_name = a_res->name() + ":" + a_file_name;
+
+   // Check the cache for the model
+   shared_ptr<promise<IModelPtr> > loading;
+   ModelFuture result;
+   {
+      lock_guard<mutex> lock(cache_mutex);
+
+      ModelCache::iterator it = the_cache.find(cache_name);
+      if (it != the_cache.end())
+         result = (*it).second;
+      else {
+         loading = make_shared<promise<IModelPtr> >();
+         result = loading->get_future();
+         the_cache[cache_name] = result;
+      }
+   }
+
+   // Another thread may still be loading it
+   if (!loading)
+      return result.get();
+
+   try {
+      IModelPtr ptr = read_model(a_res, a_file_name, a_scale, shift);
+      loading->set_value(ptr);
+      return ptr;
+   }
+   catch (...) {
+      {
+         lock_guard<mutex> lock(cache_mutex);
+         the_cache.erase(cache_name);
+      }
+
+      loading->set_exception(current_exception());
+      throw;
+   }
+}
@@ -129,67 +129,3 @@ void resizeGLScene(IWindowPtr a_window)
 {
    glViewport(0, 0, a_window->width(), a_window->height());
 }
-
-void begin_pick(IWindowPtr a_window, unsigned* a_buffer, int x, int y)
-{
-   // Set up selection buffer
-   glSelectBuffer(128, a_buffer);
-
-   // Get viewport coordinates
-   GLint viewport_coords[4];
-   glGetIntegerv(GL_VIEWPORT, viewport_coords);	
-   
-   // Switch to projection matrix
-   glMatrixMode(GL_PROJECTION);
-   glPushMatrix();
-   
-   // Render the objects, but don't change the frame buffer
-   glRenderMode(GL_SELECT);
-   glLoadIdentity();	
-   
-   // Set picking matrix
-   gluPickMatrix(x, viewport_coords[3] - y, 2, 2, viewport_coords);
-
-   // Just set the perspective
-   IConfigPtr cfg = get_config();
-   gluPerspective(45.0f, (GLfloat)(a_window->width())/(GLfloat)(a_window->height()),
-      cfg->get<float>("NearClip"),
-      cfg->get<float>("FarClip"));
-
-   glMatrixMode(GL_MODELVIEW);
-   glInitNames();
-
-   // Let the user render their stuff
-   glLoadIdentity();
-}
-
-unsigned end_pick(unsigned* a_buffer)
-{   
-   int objects_found = glRenderMode(GL_RENDER);
-   
-   // Go back to normal
-   glMatrixMode(GL_PROJECTION);
-   glPopMatrix();
-   glMatrixMode(GL_MODELVIEW);
-   
-   // See if we found any objects
-   if (objects_found > 0) {
-      // Find the object with the lowest depth
-      unsigned int lowest_depth = a_buffer[1];
-      int selected_object = a_buffer[3];
-      
-      // Go through all the objects found
-      for (int i = 1; i < objects_found; i++) {
-         // See if it's closer than the current nearest
-         if (a_buffer[(i*4) + 1] < lowest_depth) { // 4 values for each object
-            lowest_depth = a_buffer[(i * 4) + 1];
-            selected_object = a_buffer[(i * 4) + 3];
-         }
-      }
-      
-      // Return closest object
-      return selected_object;
-   }
-   else
-      return 0;
-}
@@ -24,6 +24,7 @@
 #include "OpenGLHelper.hpp"
 
 #include <cassert>
+#include <atomic>
 
 #include <boost/lexical_cast.hpp>
 
@@ -42,6 +43,8 @@ public:
    float segment_length(const track::TravelToken& a_token) const;
    bool is_valid_direction(const track::Direction& a_direction) const;
    track::Connection next_position(const track::TravelToken& a_token) const;
+   void get_exits(const track::TravelToken& a_token,
+                  vector<track::Connection>& output) const;
    void get_endpoints(PointList& a_list) const;
    void get_covers(PointList& output) const;
    void get_height_locked(PointList& output) const;
@@ -55,10 +58,13 @@ public:
 
    // IXMLSerialisable interface
    xml::element to_xml() const;
+   track::Record record() const;
 private:
-   void transform(const track::TravelToken& a_token, float a_delta) const;
+   MatrixF4 transform(const track::TravelToken& a_token, float a_delta) const;
    void ensure_valid_direction(track::Direction a_direction) const;
    void render_arrow() const;
+   track::Connection exit_position(const track::TravelToken& a_token,
+                                   bool branching) const;
 
    PointI displaced_endpoint() const;
    PointI straight_endpoint() const;
@@ -68,7 +74,9 @@ private:
    int myX, myY;
    track::Direction my_axis;
    bool reflected;
-   State state;
+
+   // Changed on the simulation thread and read while rendering
+   atomic<State> state;
    float height;
 
    // Draw the arrow over the points if true
@@ -273,10 +281,12 @@ track::TravelToken Points::get_travel_token(track::Position position,
    return tok;
 }
 
-void Points::transform(const track::TravelToken& a_token, float delta) const
+MatrixF4 Points::transform(const track::TravelToken& a_token, float delta) const
 {
    const float len = segment_length(a_token);
 
+   MatrixF4 m;
+
    assert(delta < len);
 
    if (myX == a_token.position.x && myY == a_token.position.y
@@ -293,14 +303,14 @@ void Points::transform(const track::TravelToken& a_token, float delta) const
          my_axis == axis::Y ? delta
          : (my_axis == -axis::Y ? -delta : 0.0f);
 
-      glTranslatef(static_cast<float>(myX) + x_trans,
+      m = MatrixF4::translation(static_cast<float>(myX) + x_trans,
          height,
          static_cast<float>(myY) + y_trans);
 
       if (my_axis == axis::Y || my_axis == -axis::Y)
-         glRotated(-90.0, 0.0, 1.0, 0.0);
+         m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-      glTranslated(-0.5, 0.0, 0.0);
+      m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
    }
    else if (a_token.position == straight_endpoint()) {
       delta = 2.0f - delta;
@@ -316,14 +326,14 @@ void Points::transform(const track::TravelToken& a_token, float delta) const
          my_axis == axis::Y ? delta
          : (my_axis == -axis::Y ? -delta : 0.0f);
 
-      glTranslatef(static_cast<float>(myX) + x_trans,
+      m = MatrixF4::translation(static_cast<float>(myX) + x_trans,
          height,
          static_cast<float>(myY) + y_trans);
 
       if (my_axis == axis::Y || my_axis == -axis::Y)
-         glRotatef(-90.0f, 0.0f, 1.0f, 0.0f);
+         m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-      glTranslatef(-0.5f, 0.0f, 0.0f);
+      m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
    }
    else if (a_token.position == displaced_endpoint() || state == TAKEN) {
       // Curving onto the straight section
@@ -369,23 +379,25 @@ void Points::transform(const track::TravelToken& a_token, float delta) const
       else
          assert(false);
 
-      glTranslatef(
+      m = MatrixF4::translation(
          static_cast<float>(myX) + x_trans,
          height,
          static_cast<float>(myY) + y_trans);
 
       if (my_axis == axis::Y || my_axis == -axis::Y)
-         glRotatef(-90.0f, 0.0f, 1.0f, 0.0f);
+         m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-      glTranslatef(-0.5f, 0.0f, 0.0f);
+      m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
 
-      glRotatef(rotate, 0.0f, 1.0f, 0.0f);
+      m *= MatrixF4::rotation(rotate, MatrixF4::AXIS_Y);
    }
    else
       assert(false);
 
    if (a_token.direction == -axis::X || a_token.direction == -axis::Y)
-      glRotated(-180.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-180.0f, MatrixF4::AXIS_Y);
+
+   return m;
 }
 
 void Points::ensure_valid_direction(track::Direction a_direction) const
@@ -408,8 +420,22 @@ bool Points::is_valid_direction(const track::Direction& a_direction) const
 
 track::Connection Points::next_position(const track::TravelToken& a_token) const
 {
-   const bool branching = state == TAKEN;
+   return exit_position(a_token, state == TAKEN);
+}
+
+void Points::get_exits(const track::TravelToken& a_token,
+                       vector<track::Connection>& output) const
+{
+   output.push_back(exit_position(a_token, false));
 
+   if (a_token.num_exits > 1)
+      output.push_back(exit_position(a_token, true));
+}
+
+// Where a train leaves the points if they were set to `branching'
+track::Connection Points::exit_position(const track::TravelToken& a_token,
+                                        bool branching) const
+{
    if (my_axis == axis::X) {
       if (a_token.direction == -axis::X) {
          // Two possible entry points
@@ -567,6 +593,14 @@ xml::element Points::to_xml() const
       .add_attribute("reflect", reflected);
 }
 
+track::Record Points::record() const
+{
+   track::Record r = {
+      track::Record::POINTS, { my_axis.x, my_axis.z, reflected }
+   };
+   return r;
+}
+
 void Points::next_state()
 {
    state = reflected ? NOT_TAKEN : TAKEN;
@@ -17,10 +17,12 @@
 
 #include "IQuadTree.hpp"
 #include "ILogger.hpp"
+#include "IConfig.hpp"
 
 #include <stdexcept>
 #include <sstream>
 #include <cstdlib>
+#include <cmath>
 #include <list>
 
 using namespace std;
@@ -34,6 +36,10 @@ public:
 
    void render(IGraphicsPtr a_context);
    int leaf_size() const { return QT_LEAF_SIZE; }
+   void update_heights(Point<int> bot_left, Point<int> top_right)
+   {
+      update_heights(0, bot_left, top_right);
+   }
 
 private:
    enum QuadType { QT_LEAF, QT_BRANCH };
@@ -43,11 +49,25 @@ private:
       unsigned int id;
       unsigned int children[4];
       QuadType type;
+      float min_height, max_height;
    } *sectors;
 
+   // Sectors beyond the edge of a non-square map
+   bool outside_map(const Sector& s) const
+   {
+      return s.bot_left.x >= real_width || s.bot_left.y >= real_height;
+   }
+
    int calc_num_sectors(int a_width);
    int build_node(int an_id, int a_parent, int x1, int y1, int x2, int y2);
-   void visible_sectors(IGraphicsPtr a_context, list<Sector*>& a_list, int a_sector);
+   void visible_sectors(const Frustum& frustum, list<Sector*>& a_list,
+                        int a_sector, unsigned planes);
+   void update_heights(int a_sector, const Point<int>& bot_left,
+                       const Point<int>& top_right);
+   void bounding_box(const Sector& s, Vector<float>& lo,
+                     Vector<float>& hi) const;
+   SectorLOD sector_lod(const Vector<float>& eye, const Sector& s) const;
+   int lod_level(const Vector<float>& eye, int x, int y) const;
 
    int size, num_sectors, used_sectors;
    ISectorRenderablePtr renderer;
@@ -59,7 +79,11 @@ private:
 
    int kill_count;
 
+   // Distance between terrain detail levels
+   float lod_distance;
+
    static const int QT_LEAF_SIZE = 8; 	// Number of tiles in a QuadTree leaf
+   static const int QT_MAX_LOD = 3;     // Level with one quad per leaf
 };
 
 QuadTree::QuadTree(ISectorRenderablePtr a_renderable)
@@ -68,7 +92,12 @@ QuadTree::QuadTree(ISectorRenderablePtr a_renderable)
      real_width(0), real_height(0),
      kill_count(0)
 {
+   lod_distance = get_config()->get<float>("TerrainLODDistance");
 
+   // Adjacent leaves can then differ by at most one level which is
+   // all the stitching in the renderer handles
+   if (lod_distance > 0.0f)
+      lod_distance = max(lod_distance, float(QT_LEAF_SIZE));
 }
 
 QuadTree::~QuadTree()
@@ -81,19 +110,65 @@ void QuadTree::render(IGraphicsPtr a_context)
 {
    list<Sector*> visible;
    kill_count = 0;
-   visible_sectors(a_context, visible, 0);
+   visible_sectors(a_context->view_frustum(), visible, 0,
+                   Frustum::ALL_PLANES);
+
+   const Vector<float> eye = a_context->camera_position();
 
    list<Sector*>::const_iterator it;
 
    for (it = visible.begin(); it != visible.end(); ++it)
       renderer->render_sector(a_context, (*it)->id,
-         (*it)->bot_left, (*it)->top_right);
+         (*it)->bot_left, (*it)->top_right, sector_lod(eye, **it));
 
    for (it = visible.begin(); it != visible.end(); ++it)
       renderer->post_render_sector(a_context, (*it)->id,
          (*it)->bot_left, (*it)->top_right);
 }
 
+// Pick the terrain detail for a leaf and note which of its
+// neighbours are drawn at a lower detail
+SectorLOD QuadTree::sector_lod(const Vector<float>& eye,
+                               const Sector& s) const
+{
+   SectorLOD lod;
+   lod.level = lod_level(eye, s.bot_left.x, s.bot_left.y);
+   lod.coarser = 0;
+
+   const int x = s.bot_left.x;
+   const int y = s.bot_left.y;
+
+   if (x > 0 && lod_level(eye, x - QT_LEAF_SIZE, y) > lod.level)
+      lod.coarser |= EDGE_LEFT;
+   if (s.top_right.x < real_width
+       && lod_level(eye, x + QT_LEAF_SIZE, y) > lod.level)
+      lod.coarser |= EDGE_RIGHT;
+   if (y > 0 && lod_level(eye, x, y - QT_LEAF_SIZE) > lod.level)
+      lod.coarser |= EDGE_BOTTOM;
+   if (s.top_right.y < real_height
+       && lod_level(eye, x, y + QT_LEAF_SIZE) > lod.level)
+      lod.coarser |= EDGE_TOP;
+
+   return lod;
+}
+
+// Detail level of the leaf whose bottom left tile is (x, y)
+int QuadTree::lod_level(const Vector<float>& eye, int x, int y) const
+{
+   if (lod_distance <= 0.0f)
+      return 0;
+
+   const float half = QT_LEAF_SIZE / 2.0f;
+   const Vector<float> centre =
+      make_vector(x + half - 0.5f, 0.0f, y + half - 0.5f);
+
+   // Measure to the edge of the leaf rather than its centre
+   const float dist =
+      max(0.0f, (centre - eye).length() - half * float(M_SQRT2));
+
+   return min(QT_MAX_LOD, int(dist / lod_distance));
+}
+
 // Creates a blank QuadTree
 void QuadTree::build_tree(int width, int height)
 {
@@ -115,6 +190,7 @@ void QuadTree::build_tree(int width, int height)
 
    // Build the tree
    build_node(0, 0, 0, 0, size, size);
+   update_heights(make_point(0, 0), make_point(size, size));
 }
 
 // Builds a node in the tree
@@ -126,6 +202,8 @@ int QuadTree::build_node(int an_id, int a_parent, int x1, int y1, int x2, int y2
    sectors[an_id].bot_left.y = y1;
    sectors[an_id].top_right.x = x2;
    sectors[an_id].top_right.y = y2;
+   sectors[an_id].min_height = 0.0f;
+   sectors[an_id].max_height = 0.0f;
 
    // Check to see if it's a leaf
    if (abs(x1 - x2) == QT_LEAF_SIZE && abs(y1 - y2) == QT_LEAF_SIZE)
@@ -161,9 +239,10 @@ int QuadTree::calc_num_sectors(int a_width)
       return 1;
 }
 
-// Find all the visible sectors
-void QuadTree::visible_sectors(IGraphicsPtr a_context, list<Sector*>& a_list,
-                               int a_sector)
+// Find all the visible sectors. Planes missing from `planes' are
+// known to contain the whole sector
+void QuadTree::visible_sectors(const Frustum& frustum, list<Sector*>& a_list,
+                               int a_sector, unsigned planes)
 {
    if (a_sector >= num_sectors) {
       ostringstream ss;
@@ -173,37 +252,93 @@ void QuadTree::visible_sectors(IGraphicsPtr a_context, list<Sector*>& a_list,
 
    Sector& s = sectors[a_sector];
 
-   bool bot_left_outside =
-      s.bot_left.x >= real_width
-      || s.bot_left.y >= real_height;
-   if (bot_left_outside) {
+   if (outside_map(s)) {
       // A non-square map
       return;
    }
 
+   if (planes != 0) {
+      Vector<float> lo, hi;
+      bounding_box(s, lo, hi);
+
+      if (frustum.box_in_frustum(lo, hi, planes) == Frustum::OUTSIDE) {
+         kill_count++;
+         return;
+      }
+   }
+
    // See if it's a leaf
    if (s.type == QT_LEAF)
       a_list.push_back(&s);
+   else if (planes != 0 && sectors[s.children[0]].type == QT_LEAF) {
+      // Test all four leaves at once
+      Vector<float> lo[4], hi[4];
+      for (int i = 0; i < 4; i++)
+         bounding_box(sectors[s.children[i]], lo[i], hi[i]);
+
+      unsigned visible;
+      frustum.boxes_in_frustum(lo, hi, 4, &visible, planes);
+
+      for (int i = 3; i >= 0; i--) {
+         Sector& child = sectors[s.children[i]];
+         if (outside_map(child))
+            continue;
+         else if (visible & (1 << i))
+            a_list.push_back(&child);
+         else
+            kill_count++;
+      }
+   }
    else {
       // Loop through each sector
-      for (int i = 3; i >= 0; i--) {
-         int childID = s.children[i];
-         Sector* child = &sectors[childID];
+      for (int i = 3; i >= 0; i--)
+         visible_sectors(frustum, a_list, s.children[i], planes);
+   }
+}
+
+void QuadTree::bounding_box(const Sector& s, Vector<float>& lo,
+                            Vector<float>& hi) const
+{
+   lo = make_vector(s.bot_left.x - 0.5f, s.min_height, s.bot_left.y - 0.5f);
+   hi = make_vector(s.top_right.x - 0.5f, s.max_height, s.top_right.y - 0.5f);
+}
+
+// Recalculate the height bounds below a node
+void QuadTree::update_heights(int a_sector, const Point<int>& bot_left,
+                              const Point<int>& top_right)
+{
+   Sector& s = sectors[a_sector];
 
-         int w = child->top_right.x - child->bot_left.x;
-         int h = child->top_right.y - child->bot_left.y;
+   // Sectors share the vertices along their edges
+   const bool overlaps =
+      bot_left.x <= s.top_right.x && top_right.x >= s.bot_left.x
+      && bot_left.y <= s.top_right.y && top_right.y >= s.bot_left.y;
 
-         int x = child->bot_left.x + w/2;
-         int y = child->bot_left.y + h/2;
+   if (!overlaps || outside_map(s))
+      return;
 
-         if (a_context->cube_in_view_frustum(
-                static_cast<float>(x) - 0.5f,
-                0.0f,
-                static_cast<float>(y) - 0.5f,
-                static_cast<float>(w) / 2.0f))
-            visible_sectors(a_context, a_list, childID);
-         else
-            kill_count++;
+   if (s.type == QT_LEAF) {
+      renderer->height_range(s.bot_left, s.top_right,
+                             s.min_height, s.max_height);
+      return;
+   }
+
+   bool first = true;
+   for (int i = 0; i < 4; i++) {
+      update_heights(s.children[i], bot_left, top_right);
+
+      const Sector& child = sectors[s.children[i]];
+      if (outside_map(child))
+         continue;
+
+      if (first) {
+         s.min_height = child.min_height;
+         s.max_height = child.max_height;
+         first = false;
+      }
+      else {
+         s.min_height = min(s.min_height, child.min_height);
+         s.max_height = max(s.max_height, child.max_height);
       }
    }
 }
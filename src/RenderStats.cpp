@@ -48,10 +48,14 @@ void RenderStats::update(int delta)
    
    if (ticks_until_update <= 0) {
       int avg_triangles = get_average_triangle_count();
+      size_t vertex_kb = get_vertex_memory_used() / 1024;
+      size_t saved_kb = get_vertex_memory_saved() / 1024;
       
       label.text(
          "FPS: " + boost::lexical_cast<string>(get_game_window()->get_fps())
-         + " [" + boost::lexical_cast<string>(avg_triangles) + " triangles]");
+         + " [" + boost::lexical_cast<string>(avg_triangles) + " triangles, "
+         + boost::lexical_cast<string>(vertex_kb) + "KB vertices, "
+         + boost::lexical_cast<string>(saved_kb) + "KB saved]");
 
       ticks_until_update = 1000;
    }
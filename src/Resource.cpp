@@ -17,10 +17,16 @@
 
 #include "IResource.hpp"
 #include "ILogger.hpp"
+#include "Paths.hpp"
 
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <mutex>
+#include <ctime>
 
 #include <boost/filesystem.hpp>
 
@@ -59,14 +65,14 @@ IResource::Handle::Handle(const string& file_name, Mode mode)
    : file_name_(file_name), mode_(mode), aborted(false)
 {
    if (mode == READ) {
-      read_stream = shared_ptr<ifstream>(new ifstream(file_name.c_str()));
+      read_stream = shared_ptr<ifstream>(new ifstream(file_name.c_str(), ios::binary));
 
       if (!read_stream->good())
          throw runtime_error("Failed to open resource file " + file_name);
    }
    else if (mode == WRITE) {
       const string tmp = tmp_file_name();
-      write_stream = shared_ptr<ofstream>(new ofstream(tmp.c_str()));
+      write_stream = shared_ptr<ofstream>(new ofstream(tmp.c_str(), ios::binary));
 
       if (!write_stream->good())
          throw runtime_error("Failed to open resource file " + file_name);
@@ -101,42 +107,256 @@ namespace {
       NULL
    };
 
-   typedef map<string, ResourceList> ResourceMap;
+   // Resources of one class in the order they were found with an
+   // index by name for find_resource
+   struct ResourceClass {
+      ResourceList list;
+      unordered_map<string, IResourcePtr> by_name;
+   };
+
+   typedef map<string, ResourceClass> ResourceMap;
    ResourceMap the_resources;
+   mutex resources_mutex;
+
+   const int MANIFEST_VERSION = 2;
+
+   // Special directory times: the directory does not exist, or it was
+   // modified too recently to trust the timestamp
+   const time_t MISSING = -1;
+   const time_t RACY = -2;
+
+   // Resource directory names with their times
+   typedef vector<pair<string, time_t> > DirList;
+
+   // The result of scanning one class directory which is saved in the
+   // manifest so the directory need not be read again until it changes
+   // The time of each resource directory is checked on every start as
+   // adding or removing its XML file does not change the class directory
+   struct ClassScan {
+      ClassScan() : time(MISSING) {}
+
+      time_t time;
+      DirList found;
+      DirList skipped;   // Directories without an XML file
+   };
+
+   typedef map<string, ClassScan> Manifest;
 }
 
-static ResourceList& res_class_list(const string& a_class)
+static ResourceClass& res_class(const string& a_class)
 {
-   if (the_resources.find(a_class) == the_resources.end())
-      the_resources[a_class] = ResourceList();
    return the_resources[a_class];
 }
 
 static void add_resource(const string& a_class, IResourcePtr a_res)
 {
-   res_class_list(a_class).push_back(a_res);
+   ResourceClass& rc = res_class(a_class);
+
+   // The first resource with a name wins as with the old linear search
+   if (rc.by_name.insert(make_pair(a_res->name(), a_res)).second)
+      rc.list.push_back(a_res);
+   else
+      warn() << "Duplicate resource " << a_res->name()
+             << " in class " << a_class;
 }
 
-static void add_resource_dir(const char* a_class, const path& p)
+// A timestamp within a second of now may be shared with a later
+// change so force a rescan next time
+static time_t dir_time(const path& p)
 {
-   const path xml_file = p / (p.filename().replace_extension(".xml"));
+   if (!exists(p))
+      return MISSING;
 
-   if (!exists(xml_file))
-      warn() << "Missing resource XML file: " << xml_file;
-   else
-      add_resource(a_class, IResourcePtr(new FilesystemResource(p)));
+   const time_t t = last_write_time(p);
+   return t >= time(NULL) - 1 ? RACY : t;
+}
+
+static ClassScan scan_class(const path& a_dir)
+{
+   log() << "Scanning for resources in " << a_dir;
+
+   ClassScan scan;
+   scan.time = dir_time(a_dir);
+
+   if (scan.time == MISSING)
+      return scan;
+
+   for (directory_iterator it(a_dir); it != directory_iterator(); ++it) {
+      if (!is_directory(it->status()))
+         continue;
+
+      const path p = *it;
+      const path xml_file = p / (p.filename().replace_extension(".xml"));
+
+      const pair<string, time_t> entry(p.filename().string(), dir_time(p));
+
+      if (exists(xml_file))
+         scan.found.push_back(entry);
+      else {
+         warn() << "Missing resource XML file: " << xml_file;
+         scan.skipped.push_back(entry);
+      }
+   }
+
+   return scan;
+}
+
+// True if none of the resource directories have changed
+static bool dirs_current(const path& a_dir, const DirList& dirs)
+{
+   for (DirList::const_iterator it = dirs.begin(); it != dirs.end(); ++it) {
+      if ((*it).second == RACY || dir_time(a_dir / (*it).first) != (*it).second)
+         return false;
+   }
+
+   return true;
+}
+
+// True if nothing in the class directory has changed since the scan
+// This only needs a stat of each directory rather than reading them
+static bool scan_current(const path& a_dir, const ClassScan& scan)
+{
+   if (scan.time == RACY || dir_time(a_dir) != scan.time)
+      return false;
+
+   return dirs_current(a_dir, scan.found)
+      && dirs_current(a_dir, scan.skipped);
+}
+
+static path manifest_file()
+{
+   return get_cache_dir() / "resources.manifest";
+}
+
+// The manifest is a text file with one record per line:
+//   version <n>
+//   root <directory searched>
+//   class <time> <name>
+//   res <time> <name>
+//   skip <time> <name>
+// Returns false if there is no usable manifest for this root
+static bool read_manifest(const path& a_root, Manifest& manifest)
+{
+   const string fname = manifest_file().string();
+
+   std::ifstream is(fname.c_str());
+   if (!is.good())
+      return false;
+
+   int version;
+   string tag, root;
+   is >> tag >> version;
+   if (tag != "version" || version != MANIFEST_VERSION)
+      return false;
+
+   is >> tag >> ws;
+   getline(is, root);
+   if (tag != "root" || root != a_root.string())
+      return false;
+
+   ClassScan* scan = NULL;
+   while (is >> tag) {
+      if (tag == "class") {
+         string name;
+         time_t t;
+         is >> t >> ws;
+         getline(is, name);
+
+         scan = &manifest[name];
+         scan->time = t;
+      }
+      else if (tag == "res" && scan) {
+         string name;
+         time_t t;
+         is >> t >> ws;
+         getline(is, name);
+         scan->found.push_back(make_pair(name, t));
+      }
+      else if (tag == "skip" && scan) {
+         string name;
+         time_t t;
+         is >> t >> ws;
+         getline(is, name);
+         scan->skipped.push_back(make_pair(name, t));
+      }
+      else
+         return false;
+   }
+
+   return is.eof();
+}
+
+static void write_manifest(const path& a_root, const Manifest& manifest)
+{
+   const string fname = manifest_file().string();
+   const string tmp = fname + ".tmp";
+
+   {
+      std::ofstream os(tmp.c_str());
+      if (!os.good()) {
+         warn() << "Failed to create " << tmp;
+         return;
+      }
+
+      os << "version " << MANIFEST_VERSION << endl
+         << "root " << a_root.string() << endl;
+
+      for (Manifest::const_iterator it = manifest.begin();
+           it != manifest.end(); ++it) {
+         const ClassScan& scan = (*it).second;
+
+         os << "class " << scan.time << " " << (*it).first << endl;
+
+         for (DirList::const_iterator r = scan.found.begin();
+              r != scan.found.end(); ++r)
+            os << "res " << (*r).second << " " << (*r).first << endl;
+
+         for (DirList::const_iterator r = scan.skipped.begin();
+              r != scan.skipped.end(); ++r)
+            os << "skip " << (*r).second << " " << (*r).first << endl;
+      }
+
+      if (!os.good()) {
+         warn() << "Failed to write " << tmp;
+         return;
+      }
+   }
+
+   rename(tmp, fname);
 }
 
 static void look_in_dir(const path& a_path)
 {
    log() << "Looking for resources in " << a_path;
 
+   Manifest manifest;
+   if (!read_manifest(a_path, manifest))
+      manifest.clear();
+
+   bool changed = false;
+
    for (const char** p = classes; *p != NULL; ++p) {
-      if (exists(a_path / *p)) {
-         for (directory_iterator it(a_path / *p);
-              it != directory_iterator(); ++it)
-            if (is_directory(it->status()))
-               add_resource_dir(*p, *it);
+      const path dir = a_path / *p;
+
+      Manifest::iterator it = manifest.find(*p);
+      if (it == manifest.end() || !scan_current(dir, (*it).second)) {
+         manifest[*p] = scan_class(dir);
+         changed = true;
+      }
+
+      const ClassScan& scan = manifest[*p];
+      for (DirList::const_iterator r = scan.found.begin();
+           r != scan.found.end(); ++r)
+         add_resource(*p,
+                      IResourcePtr(new FilesystemResource(dir / (*r).first)));
+   }
+
+   if (changed) {
+      try {
+         write_manifest(a_path, manifest);
+      }
+      catch (const exception& e) {
+         warn() << "Failed to save resource manifest: " << e.what();
       }
    }
 }
@@ -144,13 +364,15 @@ static void look_in_dir(const path& a_path)
 // Set up the resource database and cache available objects
 void init_resources()
 {
+   lock_guard<mutex> lock(resources_mutex);
+
    look_in_dir(current_path());
 
    ostringstream ss;
    ss << "Found ";
 
    for (const char **it = classes; *it; ++it) {
-      const ResourceList& lst = res_class_list(*it);
+      const ResourceList& lst = res_class(*it).list;
 
       if (it != classes)
          ss << ", ";
@@ -163,7 +385,9 @@ void init_resources()
 // Find all the resources of the given type
 void enum_resources(const string& a_class, ResourceList& a_list)
 {
-   ResourceList& lst = res_class_list(a_class);
+   lock_guard<mutex> lock(resources_mutex);
+
+   ResourceList& lst = res_class(a_class).list;
    copy(lst.begin(), lst.end(), back_inserter(a_list));
 }
 
@@ -172,13 +396,18 @@ void enum_resources(const string& a_class, ResourceList& a_list)
 static IResourcePtr maybe_find_resource(const string& a_res_id,
                                         const string& a_class)
 {
-   ResourceList& rlist = res_class_list(a_class);
-   for (ResourceListIt it = rlist.begin(); it != rlist.end(); ++it) {
-      if ((*it)->name() == a_res_id)
-         return *it;
-   }
+   lock_guard<mutex> lock(resources_mutex);
+
+   ResourceMap::const_iterator rc = the_resources.find(a_class);
+   if (rc == the_resources.end())
+      return IResourcePtr();
 
-   return IResourcePtr();
+   unordered_map<string, IResourcePtr>::const_iterator it =
+      (*rc).second.by_name.find(a_res_id);
+   if (it == (*rc).second.by_name.end())
+      return IResourcePtr();
+   else
+      return (*it).second;
 }
 
 // Find a resource or throw an exception on failure
@@ -211,6 +440,8 @@ IResourcePtr make_new_resource(const string& a_res_id, const string& a_class)
       throw runtime_error("Failed to create resource directory " + p.string());
 
    IResourcePtr r = IResourcePtr(new FilesystemResource(p));
+
+   lock_guard<mutex> lock(resources_mutex);
    add_resource(a_class, r);
 
    return r;
@@ -0,0 +1,406 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "IRoutePlanner.hpp"
+#include "ILogger.hpp"
+
+#include <map>
+#include <queue>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+// Dijkstra's algorithm over the arcs of the track graph
+// Searching arcs rather than nodes means a train arriving at points
+// from one side can only leave by the exits on the other
+class RoutePlanner : public IRoutePlanner {
+public:
+   RoutePlanner(IMapPtr map);
+   ~RoutePlanner();
+
+   // IRoutePlanner interface
+   bool find_route(IStationPtr from, IStationPtr to, Route& route);
+   bool find_route(IStationPtr from, track::Direction direction,
+                   IStationPtr to, Route& route);
+   void set_points(const Route& route) const;
+
+private:
+   // A cached answer to find_route along with where any other
+   // route between the stations must start and finish
+   struct CacheEntry {
+      bool found;
+      Route route;
+      PointList starts, ends;
+   };
+   struct CacheKey {
+      IStationPtr from, to;
+      track::Direction direction;   // Zero to leave either way
+
+      bool operator<(const CacheKey& rhs) const
+      {
+         return make_tuple(from, to, direction)
+            < make_tuple(rhs.from, rhs.to, rhs.direction);
+      }
+   };
+
+   bool plan(const CacheKey& key, Route& route);
+   bool leaves_by(int arc, const track::Direction& direction) const;
+
+   void refresh();
+   void build_graph();
+   void invalidate(const PointI& changed);
+   bool affected(const CacheKey& key, const CacheEntry& entry,
+                 const PointI& changed) const;
+   bool search(unsigned from, unsigned to,
+               const track::Direction& direction, Route& route) const;
+   void cover_tiles(Route& route) const;
+
+   static float distance(const PointI& a, const PointI& b);
+   static float nearest(const PointList& points, const PointI& p);
+
+   IMapPtr map;
+   ITrackGraphPtr track_graph;   // Rebuilt when the track changes
+   unsigned generation;          // Held on the map since last refresh
+
+   // Every arc in the graph and the arcs a train can take after it
+   vector<const graph::Arc*> arcs;
+   vector<vector<int> > successors;
+   vector<vector<int> > departures;   // Arcs leaving each node
+   std::map<IStationPtr, unsigned> station_nodes;
+
+   std::map<CacheKey, CacheEntry> cache;
+
+   // Allowance for track measured from the edge rather than the
+   // centre of a tile when bounding the length of new routes
+   static const float SLACK;
+};
+
+const float RoutePlanner::SLACK = 2.0f;
+
+RoutePlanner::RoutePlanner(IMapPtr map)
+   : map(map), generation(map->track_generation())
+{
+   map->hold_track_changes(generation);
+}
+
+RoutePlanner::~RoutePlanner()
+{
+   map->release_track_changes(generation);
+}
+
+bool RoutePlanner::find_route(IStationPtr from, IStationPtr to,
+                              Route& route)
+{
+   const CacheKey key = { from, to, make_vector(0, 0, 0) };
+   return plan(key, route);
+}
+
+bool RoutePlanner::find_route(IStationPtr from, track::Direction direction,
+                              IStationPtr to, Route& route)
+{
+   const CacheKey key = { from, to, direction };
+   return plan(key, route);
+}
+
+bool RoutePlanner::plan(const CacheKey& key, Route& route)
+{
+   refresh();
+
+   auto it = cache.find(key);
+   if (it != cache.end()) {
+      route = (*it).second.route;
+      return (*it).second.found;
+   }
+
+   if (!track_graph)
+      build_graph();
+
+   CacheEntry entry;
+   entry.found = false;
+   entry.route.length = 0.0f;
+
+   auto f = station_nodes.find(key.from);
+   auto t = station_nodes.find(key.to);
+   if (f != station_nodes.end() && t != station_nodes.end()) {
+      const unsigned from_node = (*f).second;
+      const unsigned to_node = (*t).second;
+
+      entry.found = search(from_node, to_node, key.direction, entry.route);
+
+      for (auto a : departures[from_node]) {
+         if (leaves_by(a, key.direction))
+            entry.starts.push_back(arcs[a]->departure.first);
+      }
+
+      for (auto a : arcs) {
+         if (a->end == to_node)
+            entry.ends.push_back(a->arrival.first);
+      }
+   }
+
+   cache[key] = entry;
+   route = entry.route;
+   return entry.found;
+}
+
+// Throw away the graph and any cached routes that might have
+// changed since the last query
+// The graph is always rebuilt in full on the next uncached query:
+// compiling it is a single walk over the track whereas patching it
+// would mean finding and merging every arc through the changed tiles
+// Routes kept in the cache refer to track connections rather than
+// node numbers so they survive the rebuild
+void RoutePlanner::refresh()
+{
+   const unsigned now = map->track_generation();
+   if (now == generation)
+      return;
+
+   PointList changed;
+   map->track_changes(generation, changed);
+
+   sort(changed.begin(), changed.end());
+   changed.erase(unique(changed.begin(), changed.end()), changed.end());
+
+   for (auto& p : changed)
+      invalidate(p);
+
+   debug() << "Track changed on " << changed.size() << " tiles: "
+           << cache.size() << " cached routes still valid";
+
+   track_graph.reset();
+
+   map->hold_track_changes(now);
+   map->release_track_changes(generation);
+   generation = now;
+}
+
+void RoutePlanner::invalidate(const PointI& changed)
+{
+   auto it = cache.begin();
+   while (it != cache.end()) {
+      if (affected((*it).first, (*it).second, changed))
+         cache.erase(it++);
+      else
+         ++it;
+   }
+}
+
+// True if a change to the track on one tile could give a different
+// answer for this pair of stations
+bool RoutePlanner::affected(const CacheKey& key, const CacheEntry& entry,
+                            const PointI& changed) const
+{
+   // New track might join up stations that were not connected
+   if (!entry.found)
+      return true;
+
+   if (binary_search(entry.route.tiles.begin(), entry.route.tiles.end(),
+                     changed))
+      return true;
+
+   const IStationPtr station = map->station_at(changed);
+   if (station == key.from || station == key.to)
+      return true;
+
+   // Any new route must pass over the changed tile and cannot be
+   // shorter than the straight line through it
+   const float bound = nearest(entry.starts, changed)
+      + nearest(entry.ends, changed) - SLACK;
+
+   return bound < entry.route.length;
+}
+
+float RoutePlanner::distance(const PointI& a, const PointI& b)
+{
+   const float dx = a.x - b.x;
+   const float dy = a.y - b.y;
+   return sqrtf(dx*dx + dy*dy);
+}
+
+float RoutePlanner::nearest(const PointList& points, const PointI& p)
+{
+   float best = numeric_limits<float>::max();
+   for (auto& q : points)
+      best = min(best, distance(p, q));
+   return best;
+}
+
+// Index the arcs of a new graph by which others can follow them
+void RoutePlanner::build_graph()
+{
+   track_graph = make_track_graph(map);
+
+   arcs.clear();
+   station_nodes.clear();
+
+   const unsigned n_nodes = track_graph->node_count();
+   departures.assign(n_nodes, vector<int>());
+
+   std::map<pair<unsigned, track::Connection>, int> by_departure;
+
+   for (unsigned n = 0; n < n_nodes; n++) {
+      const graph::Node& node = track_graph->node(n);
+
+      if (node.type == graph::NODE_STATION)
+         station_nodes[node.station] = n;
+
+      for (auto& a : node.arcs) {
+         by_departure[make_pair(n, a.departure)] = arcs.size();
+         departures[n].push_back(arcs.size());
+         arcs.push_back(&a);
+      }
+   }
+
+   successors.assign(arcs.size(), vector<int>());
+
+   vector<track::Connection> exits;
+   for (unsigned i = 0; i < arcs.size(); i++) {
+      const graph::Arc& a = *arcs[i];
+      if (track_graph->node(a.end).type == graph::NODE_DEAD_END)
+         continue;
+
+      ITrackSegmentPtr track = map->track_at(a.arrival.first);
+      const track::TravelToken token =
+         track->get_travel_token(a.arrival.first, a.arrival.second);
+
+      exits.clear();
+      track->get_exits(token, exits);
+
+      for (auto& c : exits) {
+         auto it = by_departure.find(make_pair(a.end, c));
+         if (it != by_departure.end())
+            successors[i].push_back((*it).second);
+      }
+   }
+}
+
+// True if a train travelling in this direction can start along an arc
+bool RoutePlanner::leaves_by(int arc, const track::Direction& direction) const
+{
+   return direction == make_vector(0, 0, 0)
+      || arcs[arc]->departure.second == direction;
+}
+
+bool RoutePlanner::search(unsigned from, unsigned to,
+                          const track::Direction& direction,
+                          Route& route) const
+{
+   route.length = 0.0f;
+   route.steps.clear();
+   route.tiles.clear();
+
+   if (from == to)
+      return true;
+
+   vector<float> dist(arcs.size(), numeric_limits<float>::max());
+   vector<int> prev(arcs.size(), -1);
+
+   typedef pair<float, int> QueueItem;
+   priority_queue<QueueItem, vector<QueueItem>, greater<QueueItem> > queue;
+
+   for (auto a : departures[from]) {
+      if (leaves_by(a, direction)) {
+         dist[a] = arcs[a]->length;
+         queue.push(make_pair(dist[a], a));
+      }
+   }
+
+   while (!queue.empty()) {
+      const QueueItem top = queue.top();
+      queue.pop();
+
+      const int a = top.second;
+      if (top.first > dist[a])
+         continue;   // Already found a shorter way here
+
+      if (arcs[a]->end == to) {
+         for (int i = a; i != -1; i = prev[i]) {
+            const RouteStep step = {
+               arcs[i]->departure, arcs[i]->arrival, arcs[i]->length
+            };
+            route.steps.push_back(step);
+         }
+         reverse(route.steps.begin(), route.steps.end());
+
+         route.length = dist[a];
+         cover_tiles(route);
+         return true;
+      }
+
+      for (auto s : successors[a]) {
+         const float d = dist[a] + arcs[s]->length;
+         if (d < dist[s]) {
+            dist[s] = d;
+            prev[s] = a;
+            queue.push(make_pair(d, s));
+         }
+      }
+   }
+
+   return false;
+}
+
+// Find every tile the route passes over
+void RoutePlanner::cover_tiles(Route& route) const
+{
+   for (auto& s : route.steps) {
+      track::Connection c = s.departure;
+      for (;;) {
+         ITrackSegmentPtr track = map->track_at(c.first);
+         track->get_endpoints(route.tiles);
+         track->get_covers(route.tiles);
+
+         if (c == s.arrival)
+            break;
+
+         c = track->next_position(
+            track->get_travel_token(c.first, c.second));
+      }
+   }
+
+   sort(route.tiles.begin(), route.tiles.end());
+   route.tiles.erase(unique(route.tiles.begin(), route.tiles.end()),
+                     route.tiles.end());
+}
+
+void RoutePlanner::set_points(const Route& route) const
+{
+   for (unsigned i = 1; i < route.steps.size(); i++) {
+      const track::Connection& arrival = route.steps[i - 1].arrival;
+      const track::Connection& departure = route.steps[i].departure;
+
+      ITrackSegmentPtr track = map->track_at(arrival.first);
+      if (!track->has_multiple_states())
+         continue;
+
+      const track::TravelToken token =
+         track->get_travel_token(arrival.first, arrival.second);
+
+      if (track->next_position(token) != departure)
+         track->next_state();
+      if (track->next_position(token) != departure)
+         track->prev_state();
+
+      assert(track->next_position(token) == departure);
+   }
+}
+
+IRoutePlannerPtr make_route_planner(IMapPtr map)
+{
+   return IRoutePlannerPtr(new RoutePlanner(map));
+}
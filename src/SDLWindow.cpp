@@ -19,9 +19,11 @@
 #include "ILogger.hpp"
 #include "IPickBuffer.hpp"
 #include "Maths.hpp"
+#include "Matrix.hpp"
 #include "OpenGLHelper.hpp"
 #include "IConfig.hpp"
 #include "IMesh.hpp"
+#include "ISimulationThread.hpp"
 
 #include <stdexcept>
 #include <sstream>
@@ -59,10 +61,11 @@ public:
                   const Vector<float>& a_rotation);
    void look_at(const Vector<float> an_eye_point,
                const Vector<float> a_target_point);
+   Vector<float> camera_position() const { return eye; }
+   const Frustum& view_frustum() const { return frustum; }
 
    // IPickBuffer interface
-   IGraphicsPtr begin_pick(int x, int y);
-   unsigned end_pick();
+   Ray pick_ray(int x, int y) const;
 private:
    void process_input();
    MouseButton from_sdl_button(Uint8 aSDLButton) const;
@@ -73,11 +76,14 @@ private:
    IScreenPtr screen;
    bool will_skip_next_frame;
    bool will_take_screen_shot;
-   Frustum view_frustum;
+   Frustum frustum;
+   Vector<float> eye;
 
-   // Picking data
-   static const int SELECT_BUFFER_SZ = 128;
-   GLuint my_select_buffer[SELECT_BUFFER_SZ];
+   // Rows are the camera's right, up and backward axes in world space
+   MatrixF4 view_rotation;
+
+   // Most simulation ticks to run before drawing a frame
+   static const int MAX_TICKS_PER_FRAME = 5;
 };
 
 // Calculation and display of the FPS rate
@@ -120,7 +126,8 @@ struct FrameTimerThread {
 // Create the game window
 SDLWindow::SDLWindow()
    : am_running(false), will_skip_next_frame(false),
-     will_take_screen_shot(false)
+     will_take_screen_shot(false),
+     view_rotation(MatrixF4::identity())
 {
    IConfigPtr cfg = get_config();
 
@@ -188,6 +195,10 @@ void SDLWindow::run(IScreenPtr a_screen, int frames)
 
    FrameTimerThread fps_timer;
 
+   // The simulation runs at a fixed rate independent of the frame rate
+   const int tick_ms = simulation_tick_ms();
+   int accumulator = 0;
+
    unsigned last_tick = SDL_GetTicks();
 
    // Wait a few milliseconds to get a reasonable tick delta
@@ -200,7 +211,17 @@ void SDLWindow::run(IScreenPtr a_screen, int frames)
 
       try {
          process_input();
-         screen->update(shared_from_this(), delta);
+
+         // Drop time rather than falling further behind after a
+         // long frame such as loading a map
+         accumulator = min(accumulator + delta, MAX_TICKS_PER_FRAME * tick_ms);
+
+         while (accumulator >= tick_ms) {
+            screen->update(shared_from_this(), tick_ms);
+            accumulator -= tick_ms;
+         }
+
+         screen->interpolate(float(accumulator) / float(tick_ms));
 
          if (!will_skip_next_frame) {
             drawGLScene(shared_from_this(), shared_from_this(), screen);
@@ -307,19 +328,29 @@ void SDLWindow::process_input()
    }
 }
 
-// Set up OpenGL to pick out objects
-IGraphicsPtr SDLWindow::begin_pick(int x, int y)
+// Unproject a window co-ordinate using the same perspective as
+// drawGLScene without reading anything back from OpenGL
+Ray SDLWindow::pick_ray(int x, int y) const
 {
-   ::begin_pick(shared_from_this(), my_select_buffer, x, y);
-   return shared_from_this();
-}
+   const float tan_half_fov = tanf(deg_to_rad(45.0f) / 2.0f);
+   const float aspect = float(width_) / float(height_);
 
-// Finish picking and return the name of the clicked object or zero
-// It's *very* important that this is called exactly once for every
-// begin_pick or things will get very messed up
-unsigned SDLWindow::end_pick()
-{
-   return ::end_pick(my_select_buffer);
+   // Normalised device co-ordinates with y pointing up
+   const float ndc_x = 2.0f * (x + 0.5f) / width_ - 1.0f;
+   const float ndc_y = 1.0f - 2.0f * (y + 0.5f) / height_;
+
+   const float cx = ndc_x * tan_half_fov * aspect;
+   const float cy = ndc_y * tan_half_fov;
+
+   // The inverse of a rotation is its transpose
+   const float (*r)[4] = view_rotation.entries;
+   Vector<float> dir = make_vector(
+      r[0][0] * cx + r[1][0] * cy - r[2][0],
+      r[0][1] * cx + r[1][1] * cy - r[2][1],
+      r[0][2] * cx + r[1][2] * cy - r[2][2]);
+
+   Ray ray = { eye, dir.normalise() };
+   return ray;
 }
 
 // Called to set the camera position
@@ -331,7 +362,11 @@ void SDLWindow::set_camera(const Vector<float>& a_pos,
    glRotatef(a_rotation.z, 0.0f, 0.0f, 1.0f);
    glTranslatef(a_pos.x, a_pos.y, a_pos.z);
 
-   view_frustum = get_view_frustum();
+   eye = -a_pos;
+   view_rotation = MatrixF4::rotation(a_rotation.x, MatrixF4::AXIS_X)
+      * MatrixF4::rotation(a_rotation.y, MatrixF4::AXIS_Y)
+      * MatrixF4::rotation(a_rotation.z, MatrixF4::AXIS_Z);
+   frustum = get_view_frustum();
 }
 
 // A wrapper around glu_look_at
@@ -342,26 +377,42 @@ void SDLWindow::look_at(const Vector<float> an_eye_point,
              a_target_point.x, a_target_point.y, a_target_point.z,
              0, 1, 0);
 
-   view_frustum = get_view_frustum();
+   // Same basis as gluLookAt builds
+   Vector<float> f = a_target_point - an_eye_point;
+   f.normalise();
+   Vector<float> side = f * make_vector(0.0f, 1.0f, 0.0f);
+   side.normalise();
+   const Vector<float> up = side * f;
+
+   const float data[4][4] = {
+      { side.x, side.y, side.z, 0.0f },
+      { up.x,   up.y,   up.z,   0.0f },
+      { -f.x,   -f.y,   -f.z,   0.0f },
+      { 0.0f,   0.0f,   0.0f,   1.0f }
+   };
+   view_rotation = MatrixF4(data);
+
+   eye = an_eye_point;
+   frustum = get_view_frustum();
 }
 
 // Intersect a cuboid with the current view frustum
 bool SDLWindow::cuboid_in_view_frustum(float x, float y, float z,
                                        float sizeX, float sizeY, float sizeZ)
 {
-   return view_frustum.cuboid_in_frustum(x, y, z, sizeX, sizeY, sizeZ);
+   return frustum.cuboid_in_frustum(x, y, z, sizeX, sizeY, sizeZ);
 }
 
 // Intersect a cube with the current view frustum
 bool SDLWindow::cube_in_view_frustum(float x, float y, float z, float size)
 {
-   return view_frustum.cube_in_frustum(x, y, z, size);
+   return frustum.cube_in_frustum(x, y, z, size);
 }
 
 // True if the point is contained within the view frustum
 bool SDLWindow::point_in_view_frustum(float x, float y, float z)
 {
-   return view_frustum.point_in_frustum(x, y, z);
+   return frustum.point_in_frustum(x, y, z);
 }
 
 // Capture the OpenGL pixels and save them to a file
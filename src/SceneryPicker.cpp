@@ -29,6 +29,9 @@ public:
       const string& resource_class, const string& gui_path,
       const string& btn_gui_path);
 
+   // ISceneryPicker interface
+   ISceneryPtr get() const;
+
 protected: 
    void next();   
    void prev();
@@ -38,14 +41,24 @@ protected:
    void hide();
 
    void change_active(const string& new_res_name);
+   void update_active();
    void select_first_item();
+
+   // Start loading a resource in the background and return true once
+   // load() will not block
+   virtual bool prefetch(const string& name) const = 0;
+   virtual ISceneryPtr load(const string& name) const = 0;
    
    ResourceList resource_list;
-   ResourceList::const_iterator resource_it;
+   ResourceList::const_iterator resource_it;   // Item being picked
+   ResourceList::const_iterator active_it;     // Item on display
    ISceneryPtr active_item;
    gui::ILayoutPtr layout;
    float rotation;
-   string res_name, gui_path, res_class;
+   string res_name;       // Resource name of active_item
+   string pending_name;   // Resource name of the item loading
+   string gui_path, res_class;
+   bool loading;
 };
 
 SceneryPicker::SceneryPicker(gui::ILayoutPtr l,
@@ -54,7 +67,8 @@ SceneryPicker::SceneryPicker(gui::ILayoutPtr l,
    : layout(l),
      rotation(0.0f),
      gui_path(gui_path),
-     res_class(resource_class)
+     res_class(resource_class),
+     loading(false)
 {
    using namespace placeholders;
    
@@ -86,7 +100,7 @@ void SceneryPicker::select_first_item()
    if (resource_list.empty())
       warn() << "No scenery found in class " << res_class;
    else {
-      resource_it = resource_list.begin();
+      resource_it = active_it = resource_list.begin();
       change_active((*resource_it)->name());
    }
 }
@@ -127,19 +141,54 @@ void SceneryPicker::render_preview(gui::Widget& canvas)
    glTranslatef(1.5f, -2.6f, -1.5f);
    glColor3f(1.0f, 1.0f, 1.0f);
    sun->apply();
-   
-   active_item->render();
+
+   update_active();
+
+   if (active_item)
+      active_item->render();
+}
+
+// The item on display which has already loaded unless nothing has
+// been shown yet
+ISceneryPtr SceneryPicker::get() const
+{
+   return load(active_item ? res_name : pending_name);
 }
 
 void SceneryPicker::change_active(const string& new_res_name)
 {
-   if (new_res_name != res_name) {
-      res_name = new_res_name;
-      active_item = this->get();
-      
+   pending_name = new_res_name;
+   loading = !active_item || new_res_name != res_name;
+
+   update_active();
+}
+
+// The previous item stays on display, and is what get() places, until
+// the new one has loaded or if it fails to load
+void SceneryPicker::update_active()
+{
+   if (!loading)
+      return;
+
+   try {
+      if (!prefetch(pending_name))
+         return;
+
+      active_item = load(pending_name);
+      active_it = resource_it;
+      res_name = pending_name;
+
       layout->cast<gui::Label&>(gui_path + "/name")
          .text(active_item->name());
-   }   
+   }
+   catch (runtime_error& e) {
+      warn() << "Failed to load " << pending_name << ": " << e.what();
+
+      resource_it = active_it;
+      pending_name = res_name;
+   }
+
+   loading = false;
 }
 
 void SceneryPicker::rotate()
@@ -148,7 +197,8 @@ void SceneryPicker::rotate()
    if (rotation >= 350.0f)
       rotation = 0.0f;
 
-   active_item->set_angle(rotation);
+   if (active_item)
+      active_item->set_angle(rotation);
 }
 
 class BuildingPicker : public SceneryPicker {
@@ -160,9 +210,15 @@ public:
       select_first_item();
    }
 
-   virtual ISceneryPtr get() const
+protected:
+   bool prefetch(const string& name) const
    {
-      return load_building(res_name, rotation);
+      return prefetch_building(name);
+   }
+
+   ISceneryPtr load(const string& name) const
+   {
+      return load_building(name, rotation);
    }
 };
 
@@ -175,9 +231,15 @@ public:
       select_first_item();
    }
 
-   virtual ISceneryPtr get() const
+protected:
+   bool prefetch(const string& name) const
+   {
+      return prefetch_tree(name);
+   }
+
+   ISceneryPtr load(const string& name) const
    {
-      return load_tree(res_name);
+      return load_tree(name);
    }
 };
    
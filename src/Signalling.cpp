@@ -0,0 +1,283 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "ISignalling.hpp"
+#include "ITrackGraph.hpp"
+#include "IterateTrack.hpp"
+#include "ILogger.hpp"
+
+#include <unordered_map>
+#include <map>
+
+// Blocks are found by walking every arc of the track graph once
+// Everything a train needs as it moves is then a hash lookup
+class Signalling : public ISignalling {
+public:
+   Signalling(IMapPtr map);
+
+   // ISignalling interface
+   int block_count() const { return parts.size(); }
+   int block_of(const ITrackSegmentPtr& track) const;
+   int block_ahead(const ITrackSegmentPtr& track,
+                   const track::TravelToken& token,
+                   float& distance) const;
+   void enter_block(int block, int train);
+   void leave_block(int block, int train);
+   SignalAspect aspect(int block, int train) const;
+
+private:
+   // A segment entered in a particular direction
+   typedef pair<const ITrackSegment*, int> AheadKey;
+
+   struct AheadKeyHash {
+      size_t operator()(const AheadKey& k) const
+      {
+         return hash<const ITrackSegment*>()(k.first) ^ k.second;
+      }
+   };
+
+   struct Ahead {
+      int block;
+      float distance;
+   };
+
+   static AheadKey ahead_key(const ITrackSegment* track,
+                             const track::Direction& dir);
+
+   void walk_arc(const graph::Arc& arc,
+                 const set<ITrackSegmentPtr>& node_tracks);
+   int add_block();
+
+   IMapPtr map;
+
+   unordered_map<const ITrackSegment*, int> blocks;
+   unordered_map<AheadKey, Ahead, AheadKeyHash> ahead;
+   std::map<IStationPtr, int> station_blocks;
+
+   // Occupancy of each block
+   vector<int> parts;   // Count of train parts inside
+   vector<int> owner;   // Train the parts belong to
+
+   static const int NO_TRAIN = -1;
+   static const int SHARED = -2;   // More than one train
+};
+
+const int ISignalling::NO_BLOCK;
+const int Signalling::NO_TRAIN;
+const int Signalling::SHARED;
+
+Signalling::Signalling(IMapPtr map)
+   : map(map)
+{
+   ITrackGraphPtr track_graph = make_track_graph(map);
+
+   // Points and the start position are blocks on their own
+   set<ITrackSegmentPtr> node_tracks;
+   for (unsigned n = 0; n < track_graph->node_count(); n++) {
+      const graph::Node& node = track_graph->node(n);
+
+      if (node.type == graph::NODE_POINTS || node.type == graph::NODE_ROOT) {
+         node_tracks.insert(node.track);
+         blocks[node.track.get()] = add_block();
+      }
+   }
+
+   for (unsigned n = 0; n < track_graph->node_count(); n++) {
+      for (auto& a : track_graph->node(n).arcs)
+         walk_arc(a, node_tracks);
+   }
+
+   log() << "Split track into " << parts.size() << " signal blocks";
+}
+
+int Signalling::add_block()
+{
+   parts.push_back(0);
+   owner.push_back(NO_TRAIN);
+   return parts.size() - 1;
+}
+
+Signalling::AheadKey Signalling::ahead_key(const ITrackSegment* track,
+                                           const track::Direction& dir)
+{
+   return make_pair(track, (dir.x + 1) * 3 + (dir.z + 1));
+}
+
+// Assign blocks to the track along an arc and record how far each
+// segment is from the next block
+void Signalling::walk_arc(const graph::Arc& arc,
+                          const set<ITrackSegmentPtr>& node_tracks)
+{
+   struct Step {
+      const ITrackSegment* track;
+      track::Direction direction;
+      float length;
+      int block;
+   };
+   vector<Step> steps;
+
+   // The plain track along the arc, which is shared with the arc
+   // going the other way
+   int interior = NO_BLOCK;
+   bool reached_node = false;
+
+   track::Connection c = arc.departure;
+   for (;;) {
+      TrackIterator it = iterate_track(map, c.first, c.second);
+      if (it.status == TRACK_NO_MORE)
+         break;
+
+      Step s = {
+         it.track.get(), c.second, it.track->segment_length(it.token)
+      };
+
+      auto b = blocks.find(s.track);
+      if (b != blocks.end())
+         s.block = (*b).second;
+      else if (it.station) {
+         auto sb = station_blocks.find(it.station);
+         if (sb != station_blocks.end())
+            s.block = (*sb).second;
+         else
+            s.block = station_blocks[it.station] = add_block();
+      }
+      else {
+         if (interior == NO_BLOCK)
+            interior = add_block();
+         s.block = interior;
+      }
+      blocks[s.track] = s.block;
+
+      steps.push_back(s);
+
+      if (c == arc.arrival || node_tracks.count(it.track) > 0) {
+         reached_node = true;
+         break;
+      }
+
+      c = it.track->next_position(it.token);
+   }
+
+   // Work back from the end of the arc
+   // Segments at nodes are left out as the block after them depends
+   // on the points
+   Ahead next = { NO_BLOCK, 0.0f };
+   int next_block = NO_BLOCK;
+
+   const int last = int(steps.size()) - (reached_node ? 1 : 0);
+
+   if (reached_node && !steps.empty())
+      next_block = steps.back().block;
+
+   for (int i = last - 1; i >= 0; i--) {
+      const Step& s = steps[i];
+
+      Ahead a;
+      if (s.block != next_block) {
+         a.block = next_block;
+         a.distance = s.length;
+      }
+      else {
+         a.block = next.block;
+         a.distance = s.length + next.distance;
+      }
+
+      ahead[ahead_key(s.track, s.direction)] = a;
+
+      next = a;
+      next_block = s.block;
+   }
+}
+
+int Signalling::block_of(const ITrackSegmentPtr& track) const
+{
+   auto it = blocks.find(track.get());
+   return it == blocks.end() ? NO_BLOCK : (*it).second;
+}
+
+int Signalling::block_ahead(const ITrackSegmentPtr& track,
+                            const track::TravelToken& token,
+                            float& distance) const
+{
+   auto it = ahead.find(ahead_key(track.get(), token.direction));
+   if (it != ahead.end()) {
+      distance = (*it).second.distance;
+      return (*it).second.block;
+   }
+
+   // Only segments at nodes are missing so look one step ahead to
+   // see which way the points are set
+   distance = track->segment_length(token);
+
+   track::Position pos;
+   track::Direction dir;
+   tie(pos, dir) = track->next_position(token);
+
+   if (!map->is_valid_track(pos))
+      return NO_BLOCK;
+
+   ITrackSegmentPtr next = map->track_at(pos);
+   const int block = block_of(next);
+   if (block != block_of(track))
+      return block;
+
+   // Still inside a station
+   auto n = ahead.find(ahead_key(next.get(), dir));
+   if (n == ahead.end())
+      return NO_BLOCK;
+
+   distance += (*n).second.distance;
+   return (*n).second.block;
+}
+
+void Signalling::enter_block(int block, int train)
+{
+   if (block == NO_BLOCK)
+      return;
+
+   if (parts[block]++ == 0)
+      owner[block] = train;
+   else if (owner[block] != train)
+      owner[block] = SHARED;
+}
+
+void Signalling::leave_block(int block, int train)
+{
+   if (block == NO_BLOCK)
+      return;
+
+   assert(parts[block] > 0);
+
+   // A block stays shared until it empties which errs on the side
+   // of danger
+   if (--parts[block] == 0)
+      owner[block] = NO_TRAIN;
+}
+
+SignalAspect Signalling::aspect(int block, int train) const
+{
+   if (block == NO_BLOCK)
+      return SIGNAL_CLEAR;
+   else if (parts[block] > 0 && owner[block] != train)
+      return SIGNAL_DANGER;
+   else
+      return SIGNAL_CLEAR;
+}
+
+ISignallingPtr make_signalling(IMapPtr map)
+{
+   return ISignallingPtr(new Signalling(map));
+}
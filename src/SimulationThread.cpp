@@ -0,0 +1,151 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ISimulationThread.hpp"
+#include "IConfig.hpp"
+#include "ILogger.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace {
+   // Most ticks to run back to back after falling behind
+   const int MAX_CATCH_UP = 5;
+}
+
+class SimulationThread : public ISimulationThread {
+public:
+   SimulationThread(TickFunc tick);
+   ~SimulationThread();
+
+   // ISimulationThread interface
+   void post(Job job);
+   void check_errors();
+
+private:
+   typedef chrono::steady_clock Clock;
+
+   void run();
+   void run_jobs();
+
+   TickFunc tick;
+   const Clock::duration tick_length;
+
+   mutex jobs_mutex;
+   vector<Job> jobs;
+
+   mutex error_mutex;
+   exception_ptr failure;
+
+   atomic<bool> stopping;
+   thread worker;
+};
+
+SimulationThread::SimulationThread(TickFunc tick)
+   : tick(tick),
+     tick_length(chrono::milliseconds(simulation_tick_ms())),
+     stopping(false)
+{
+   worker = thread(bind(&SimulationThread::run, this));
+}
+
+SimulationThread::~SimulationThread()
+{
+   stopping = true;
+   worker.join();
+}
+
+void SimulationThread::post(Job job)
+{
+   lock_guard<mutex> lock(jobs_mutex);
+   jobs.push_back(job);
+}
+
+void SimulationThread::check_errors()
+{
+   lock_guard<mutex> lock(error_mutex);
+   if (failure) {
+      exception_ptr e = failure;
+      failure = exception_ptr();
+      rethrow_exception(e);
+   }
+}
+
+void SimulationThread::run_jobs()
+{
+   vector<Job> ready;
+   {
+      lock_guard<mutex> lock(jobs_mutex);
+      ready.swap(jobs);
+   }
+
+   for (auto& job : ready)
+      job();
+}
+
+void SimulationThread::run()
+{
+   const int tick_ms = chrono::duration_cast<chrono::milliseconds>
+      (tick_length).count();
+
+   Clock::time_point next = Clock::now();
+
+   while (!stopping) {
+      try {
+         run_jobs();
+         tick(tick_ms);
+      }
+      catch (...) {
+         error() << "Simulation stopped";
+
+         lock_guard<mutex> lock(error_mutex);
+         failure = current_exception();
+         return;
+      }
+
+      // Drop time rather than falling further behind after a
+      // long tick
+      next += tick_length;
+      if (Clock::now() - next > tick_length * MAX_CATCH_UP)
+         next = Clock::now();
+
+      this_thread::sleep_until(next);
+   }
+}
+
+ISimulationThreadPtr make_simulation_thread(ISimulationThread::TickFunc tick)
+{
+   return ISimulationThreadPtr(new SimulationThread(tick));
+}
+
+int simulation_tick_ms()
+{
+   const int tick_rate = get_config()->get<int>("TickRate");
+   if (tick_rate <= 0 || tick_rate > 1000)
+      throw runtime_error("TickRate must be between 1 and 1000");
+
+   // Ticks are passed to the simulation in whole milliseconds so any
+   // other rate would silently run faster than configured
+   if (1000 % tick_rate != 0)
+      throw runtime_error("TickRate must divide 1000 exactly");
+
+   return 1000 / tick_rate;
+}
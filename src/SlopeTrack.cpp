@@ -47,6 +47,11 @@ public:
       track::Direction dir) const;
    bool is_valid_direction(const track::Direction& dir) const;
    track::Connection next_position(const track::TravelToken& token) const;
+   void get_exits(const track::TravelToken& a_token,
+                  vector<track::Connection>& output) const
+   {
+      output.push_back(next_position(a_token));
+   }
    void get_endpoints(vector<Point<int> >& output) const;
    void get_covers(vector<Point<int> >& output) const {};
    void get_height_locked(vector<Point<int> >& output) const;
@@ -59,10 +64,11 @@ public:
 
    // IXMLSerialisable inteface
    xml::element to_xml() const;
+   track::Record record() const;
 
 private:
    void ensure_valid_direction(const track::Direction& dir) const;
-   void transform(const track::TravelToken& token, float delta) const;
+   MatrixF4 transform(const track::TravelToken& token, float delta) const;
    float gradient(const track::TravelToken& token, float delta) const;
 
    Point<int> origin;
@@ -211,7 +217,8 @@ float SlopeTrack::gradient(const track::TravelToken& token, float delta) const
    return curve.deriv(delta / length).y;
 }
 
-void SlopeTrack::transform(const track::TravelToken& token, float delta) const
+MatrixF4 SlopeTrack::transform(const track::TravelToken& token,
+                               float delta) const
 {
    assert(delta < length && delta >= 0.0f);
 
@@ -237,26 +244,29 @@ void SlopeTrack::transform(const track::TravelToken& token, float delta) const
    const float y_trans =curve_value.y;
    const float z_trans = axis == axis::Y ? curve_value.x : 0.0f;
 
-   glTranslated(static_cast<double>(origin.x) + x_trans,
+   MatrixF4 m = MatrixF4::translation(
+      static_cast<float>(origin.x) + x_trans,
       height + y_trans,
-      static_cast<double>(origin.y) + z_trans);
+      static_cast<float>(origin.y) + z_trans);
 
    if (axis == axis::Y)
-      glRotated(-90.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-   glTranslated(-0.5, 0.0, 0.0);
+   m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
 
    if (token.direction == -axis)
-      glRotated(-180.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-180.0f, MatrixF4::AXIS_Y);
 
    const Vector<float> deriv = curve.deriv(u_curve_delta);
    const float angle =
       rad_to_deg<float>(atanf(deriv.y / deriv.x));
 
    if (token.direction == -axis)
-      glRotatef(-angle, 0.0f, 0.0f, 1.0f);
+      m *= MatrixF4::rotation(-angle, MatrixF4::AXIS_Z);
    else
-      glRotatef(angle, 0.0f, 0.0f, 1.0f);
+      m *= MatrixF4::rotation(angle, MatrixF4::AXIS_Z);
+
+   return m;
 }
 
 void SlopeTrack::get_endpoints(vector<Point<int> >& output) const
@@ -283,6 +293,13 @@ xml::element SlopeTrack::to_xml() const
       .add_attribute("align", axis == axis::X ? "x" : "y");
 }
 
+track::Record SlopeTrack::record() const
+{
+   // Like the XML the gradient is recomputed from the height map
+   track::Record r = { track::Record::SLOPE, { axis == axis::X } };
+   return r;
+}
+
 ITrackSegmentPtr make_slope_track(track::Direction axis, Vector<float> slope,
    Vector<float> slope_before, Vector<float> slope_after)
 {
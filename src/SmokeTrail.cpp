@@ -20,6 +20,7 @@
 #include "Random.hpp"
 
 #include <list>
+#include <vector>
 
 // Concrete implementation of smoke trails
 class SmokeTrail : public ISmokeTrail {
@@ -28,7 +29,8 @@ public:
    ~SmokeTrail() {}
 
    // ISmokeTrail interface
-   void render() const;
+   void get_particles(SmokeParticleList& a_list) const;
+   void render(const SmokeParticleList& a_list) const;
    void set_position(float x, float y, float z);
    void update(int a_delta);
    void set_delay(int a_delay) { my_spawn_delay = a_delay; }
@@ -41,8 +43,6 @@ public:
       float scale;
       float r, g, b, a;
       bool appearing;
-
-      IBillboardPtr billboard;
    };
    
 private:
@@ -54,6 +54,9 @@ private:
 
    ITexturePtr particle_tex;
 
+   // Only touched by the thread that calls render
+   mutable vector<IBillboardPtr> billboards;
+
    // New particles are created every `my_spawn_delay`
    int my_spawn_delay, my_spawn_counter;
 
@@ -92,10 +95,6 @@ bool SmokeTrail::move_particle(Particle& p, int a_delta)
    
    p.scale += growth * time;
 
-   p.billboard->set_position(p.x, p.y, p.z);
-   p.billboard->set_colour(p.r, p.g, p.b, p.a);
-   p.billboard->set_scale(p.scale);
-   
    const float maxA = 0.8f;
    if (p.appearing) {
       if ((p.a += appear * time) >= maxA) {
@@ -150,23 +149,43 @@ void SmokeTrail::new_particle()
       0.4f,                         // Scale
       col, col, col,                // Colour
       0.0f,                         // Alpha
-      true,                         // Appearing
-
-      make_spherical_billboard(particle_tex)
+      true                          // Appearing
    };
 
-   p.billboard->set_position(p.x, p.y, p.z);
-   p.billboard->set_colour(p.r, p.g, p.b, p.a);
-   p.billboard->set_scale(p.scale);
-   
    particles.push_back(p);
 }
 
-void SmokeTrail::render() const
-{   
+void SmokeTrail::get_particles(SmokeParticleList& a_list) const
+{
+   a_list.clear();
+
    for (list<Particle>::const_iterator it = particles.begin();
-        it != particles.end(); ++it)
-      (*it).billboard->render();
+        it != particles.end(); ++it) {
+      const Particle& p = *it;
+      const SmokeParticle s = {
+         make_vector(p.x, p.y, p.z),
+         p.scale,
+         make_colour(p.r, p.g, p.b, p.a)
+      };
+      a_list.push_back(s);
+   }
+}
+
+void SmokeTrail::render(const SmokeParticleList& a_list) const
+{
+   // Billboards are reused between frames
+   while (billboards.size() < a_list.size())
+      billboards.push_back(make_spherical_billboard(particle_tex));
+
+   for (size_t i = 0; i < a_list.size(); i++) {
+      const SmokeParticle& s = a_list[i];
+      IBillboardPtr b = billboards[i];
+
+      b->set_position(s.position.x, s.position.y, s.position.z);
+      b->set_colour(s.colour.r, s.colour.g, s.colour.b, s.colour.a);
+      b->set_scale(s.scale);
+      b->render();
+   }
 }
 
 void SmokeTrail::set_position(float x, float y, float z)
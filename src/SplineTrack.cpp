@@ -40,6 +40,11 @@ public:
    float segment_length(const track::TravelToken& token) const;
    bool is_valid_direction(const track::Direction& dir) const;
    track::Connection next_position(const track::TravelToken& token) const;
+   void get_exits(const track::TravelToken& a_token,
+                  vector<track::Connection>& output) const
+   {
+      output.push_back(next_position(a_token));
+   }
    void get_endpoints(PointList& output) const;
    void get_covers(PointList& output) const;
    void get_height_locked(PointList& output) const;
@@ -53,6 +58,7 @@ public:
 
    // IXMLSerialisable interface
    xml::element to_xml() const;
+   track::Record record() const;
 
 private:
    typedef vector<Point<float> > Polygon;
@@ -61,7 +67,7 @@ private:
 
    float extend_from_center(track::Direction dir) const;
    void ensure_valid_direction(track::Direction dir) const;
-   void transform(const track::TravelToken& token,
+   MatrixF4 transform(const track::TravelToken& token,
                   float delta, bool backwards) const;
    float rotation_at(float delta) const;
 
@@ -359,8 +365,8 @@ float SplineTrack::rotation_at(float curve_delta) const
       return 0.0f;
 }
 
-void SplineTrack::transform(const track::TravelToken& token,
-                            float delta, bool backwards) const
+MatrixF4 SplineTrack::transform(const track::TravelToken& token,
+                                float delta, bool backwards) const
 {
    assert(delta < curve.length);
 
@@ -370,7 +376,7 @@ void SplineTrack::transform(const track::TravelToken& token,
    float u_curve_delta;
    Vector<float> curve_value = curve.linear(curve_delta, &u_curve_delta);
 
-   glTranslatef(
+   MatrixF4 m = MatrixF4::translation(
       static_cast<float>(origin.x) + curve_value.x,
       height,
       static_cast<float>(origin.y) + curve_value.z);
@@ -379,7 +385,7 @@ void SplineTrack::transform(const track::TravelToken& token,
    if (backwards)
       angle += 180.0f;
 
-   glRotatef(-angle, 0.0f, 1.0f, 0.0f);
+   return m * MatrixF4::rotation(-angle, MatrixF4::AXIS_Y);
 }
 
 track::TravelToken SplineTrack::get_travel_token(track::Position pos,
@@ -412,6 +418,15 @@ xml::element SplineTrack::to_xml() const
       .add_attribute("exit-dir-y", exit_dir.z);
 }
 
+track::Record SplineTrack::record() const
+{
+   track::Record r = {
+      track::Record::SPLINE,
+      { delta.x, delta.y, entry_dir.x, entry_dir.z, exit_dir.x, exit_dir.z }
+   };
+   return r;
+}
+
 ITrackSegmentPtr make_spline_track(VectorI delta,
                                    track::Direction entry_dir,
                                    track::Direction exit_dir)
@@ -47,6 +47,11 @@ public:
    float segment_length(const track::TravelToken& token) const { return 1.0f; }
 
    Connection next_position(const track::TravelToken& a_direction) const;
+   void get_exits(const track::TravelToken& a_token,
+                  vector<track::Connection>& output) const
+   {
+      output.push_back(next_position(a_token));
+   }
    bool is_valid_direction(const Direction& a_direction) const;
    void get_endpoints(PointList& a_list) const;
    void get_covers(PointList& output) const { }
@@ -63,9 +68,10 @@ public:
 
    // IXMLSerialisable interface
    xml::element to_xml() const;
+   track::Record record() const;
 
 private:
-   void transform(const track::TravelToken& a_token, float delta) const;
+   MatrixF4 transform(const track::TravelToken& a_token, float delta) const;
    void ensure_valid_direction(const track::Direction& a_direction) const;
 
    Point<int> origin;  // Absolute position
@@ -106,7 +112,7 @@ StraightTrack::get_travel_token(track::Position a_position,
    return tok;
 }
 
-void StraightTrack::transform(const track::TravelToken& a_token,
+MatrixF4 StraightTrack::transform(const track::TravelToken& a_token,
    float delta) const
 {
    assert(delta < 1.0);
@@ -117,17 +123,20 @@ void StraightTrack::transform(const track::TravelToken& a_token,
    const float x_trans = direction == axis::X ? delta : 0;
    const float y_trans = direction == axis::Y ? delta : 0;
 
-   glTranslated(static_cast<double>(origin.x) + x_trans,
+   MatrixF4 m = MatrixF4::translation(
+      static_cast<float>(origin.x) + x_trans,
       height,
-      static_cast<double>(origin.y) + y_trans);
+      static_cast<float>(origin.y) + y_trans);
 
    if (direction == axis::Y)
-      glRotated(-90.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-90.0f, MatrixF4::AXIS_Y);
 
-   glTranslated(-0.5, 0.0, 0.0);
+   m *= MatrixF4::translation(-0.5f, 0.0f, 0.0f);
 
    if (a_token.direction == -direction)
-      glRotated(-180.0, 0.0, 1.0, 0.0);
+      m *= MatrixF4::rotation(-180.0f, MatrixF4::AXIS_Y);
+
+   return m;
 }
 
 ITrackSegmentPtr StraightTrack::merge_exit(Point<int> where,
@@ -246,6 +255,12 @@ xml::element StraightTrack::to_xml() const
       .add_attribute("align", direction == axis::X ? "x" : "y");
 }
 
+track::Record StraightTrack::record() const
+{
+   track::Record r = { track::Record::STRAIGHT, { direction == axis::X } };
+   return r;
+}
+
 ITrackSegmentPtr make_straight_track(const Direction& a_direction)
 {
    Direction real_dir(a_direction);
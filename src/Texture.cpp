@@ -21,25 +21,33 @@
 #include <map>
 #include <sstream>
 #include <stdexcept>
+#include <mutex>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <SDL.h>
 #include <SDL_image.h>
 
+// The image is decoded when the texture is created but only uploaded
+// on the first bind so textures can be loaded on worker threads
 class Texture : public ITexture {
 public:
    Texture(const string &file);
    ~Texture();
 
-   GLuint texture() const { return my_texture; }
+   GLuint texture() const { upload(); return my_texture; }
    void bind();
 
    int width() const { return my_width; }
    int height() const { return my_height; }
 
 private:
-   GLuint my_texture;
+   void upload() const;
+
+   const string file_name;
+   mutable SDL_Surface* surface;   // Until uploaded
+   mutable GLuint my_texture;
+   mutable GLenum texture_format;
    int my_width, my_height;
 
    static bool is_power_of_two(int n);
@@ -50,10 +58,13 @@ private:
 // Texture cache
 namespace {
    map<string, ITexturePtr> the_texture_cache;
+   mutex texture_cache_mutex;
 }
 
 ITexturePtr load_texture(const string& a_file_name)
 {
+   lock_guard<mutex> lock(texture_cache_mutex);
+
    map<string, ITexturePtr>::iterator it =
       the_texture_cache.find(a_file_name);
 
@@ -81,8 +92,9 @@ ITexturePtr load_texture(IResourcePtr a_res, const string& a_file_name)
 }
 
 Texture::Texture(const string &file)
+   : file_name(file), my_texture(0)
 {
-   SDL_Surface *surface = IMG_Load(file.c_str());
+   surface = IMG_Load(file.c_str());
    if (NULL == surface) {
       ostringstream os;
       os << "Failed to load image: " << IMG_GetError();
@@ -94,11 +106,7 @@ Texture::Texture(const string &file)
    if (!is_power_of_two(surface->h))
       warn() << file << " height not a power of 2";
 
-   if (!is_texture_size_supported(surface->w, surface->h))
-      warn() << file << " bigger than max OpenGL texture";
-
    int ncols = surface->format->BytesPerPixel;
-   GLenum texture_format;
    if (ncols == 4) {
       // Contains an alpha channel
       if (surface->format->Rmask == 0x000000ff)
@@ -113,6 +121,8 @@ Texture::Texture(const string &file)
          texture_format = GL_BGR;
    }
    else {
+      SDL_FreeSurface(surface);
+
       ostringstream os;
       os << "Unsupported image colour format: " << file;
       throw runtime_error(os.str());
@@ -121,6 +131,19 @@ Texture::Texture(const string &file)
    my_width = surface->w;
    my_height = surface->h;
 
+   log() << "Loaded texture " << file;
+}
+
+void Texture::upload() const
+{
+   if (surface == NULL)
+      return;
+
+   if (!is_texture_size_supported(surface->w, surface->h))
+      warn() << file_name << " bigger than max OpenGL texture";
+
+   const int ncols = surface->format->BytesPerPixel;
+
    glGenTextures(1, &my_texture);
    glBindTexture(GL_TEXTURE_2D, my_texture);
 
@@ -134,13 +157,15 @@ Texture::Texture(const string &file)
                 texture_format, GL_UNSIGNED_BYTE, surface->pixels);
 
    SDL_FreeSurface(surface);
-
-   log() << "Loaded texture " << file;
+   surface = NULL;
 }
 
 Texture::~Texture()
 {
-   glDeleteTextures(1, &my_texture);
+   if (surface)
+      SDL_FreeSurface(surface);
+   else
+      glDeleteTextures(1, &my_texture);
 }
 
 bool Texture::is_power_of_two(int n)
@@ -161,5 +186,6 @@ bool Texture::is_texture_size_supported(int width, int height, int ncols,
 
 void Texture::bind()
 {
+   upload();
    glBindTexture(GL_TEXTURE_2D, my_texture);
 }
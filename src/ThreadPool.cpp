@@ -0,0 +1,112 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "IThreadPool.hpp"
+#include "ILogger.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+class ThreadPool : public IThreadPool {
+public:
+   ThreadPool(int threads);
+   ~ThreadPool();
+
+   // IThreadPool interface
+   void submit(Job job);
+   int thread_count() const { return workers.size(); }
+
+private:
+   void worker();
+
+   vector<thread> workers;
+   deque<Job> jobs;
+   mutex jobs_mutex;
+   condition_variable jobs_cond;
+   bool shutting_down;
+};
+
+ThreadPool::ThreadPool(int threads)
+   : shutting_down(false)
+{
+   for (int i = 0; i < threads; i++)
+      workers.push_back(thread(bind(&ThreadPool::worker, this)));
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      lock_guard<mutex> lock(jobs_mutex);
+      shutting_down = true;
+      jobs.clear();
+   }
+   jobs_cond.notify_all();
+
+   for (auto& t : workers)
+      t.join();
+}
+
+void ThreadPool::submit(Job job)
+{
+   {
+      lock_guard<mutex> lock(jobs_mutex);
+      jobs.push_back(job);
+   }
+   jobs_cond.notify_one();
+}
+
+void ThreadPool::worker()
+{
+   for (;;) {
+      Job job;
+      {
+         unique_lock<mutex> lock(jobs_mutex);
+         while (jobs.empty() && !shutting_down)
+            jobs_cond.wait(lock);
+
+         if (shutting_down)
+            return;
+
+         job = jobs.front();
+         jobs.pop_front();
+      }
+
+      try {
+         job();
+      }
+      catch (const exception& e) {
+         error() << "Background job failed: " << e.what();
+      }
+   }
+}
+
+IThreadPoolPtr make_thread_pool(int threads)
+{
+   return IThreadPoolPtr(new ThreadPool(threads));
+}
+
+IThreadPoolPtr get_thread_pool()
+{
+   // Leave one processor for the render thread
+   static IThreadPoolPtr pool =
+      make_thread_pool(max(1, int(thread::hardware_concurrency()) - 1));
+   return pool;
+}
@@ -23,6 +23,7 @@
 
 #include <cmath>
 #include <map>
+#include <mutex>
 
 namespace {
    const float RAIL_WIDTH = 0.05f;
@@ -33,6 +34,10 @@ namespace {
    const float SLEEPER_LENGTH = 0.8f;
 
    const Colour METAL = make_colour(0.5f, 0.5f, 0.5f);
+
+   // Sector meshes are built on worker threads so the shared rail
+   // and sleeper buffers must be generated under a lock
+   mutex cache_mutex;
 }
 
 IMeshBufferPtr SleeperHelper::sleeper_buf;
@@ -90,8 +95,11 @@ IMeshBufferPtr SleeperHelper::generate_sleeper_mesh_buffer()
 void SleeperHelper::merge_sleeper(IMeshBufferPtr buf,
    Vector<float> off, float y_angle) const
 {
-   if (!sleeper_buf)
-      sleeper_buf = generate_sleeper_mesh_buffer();
+   {
+      lock_guard<mutex> lock(cache_mutex);
+      if (!sleeper_buf)
+         sleeper_buf = generate_sleeper_mesh_buffer();
+   }
 
    buf->merge(sleeper_buf, off, y_angle);
 }
@@ -181,8 +189,11 @@ IMeshBufferPtr StraightTrackHelper::generate_rail_mesh_buffer()
 void StraightTrackHelper::merge_one_rail(IMeshBufferPtr buf,
    Vector<float> off, float y_angle) const
 {
-   if (!rail_buf)
-      rail_buf = generate_rail_mesh_buffer();
+   {
+      lock_guard<mutex> lock(cache_mutex);
+      if (!rail_buf)
+         rail_buf = generate_rail_mesh_buffer();
+   }
 
    buf->merge(rail_buf, off, y_angle);
 }
@@ -289,16 +300,20 @@ void CurvedTrackHelper::merge_curved_rail(IMeshBufferPtr buf, int base_radius,
 {
    IMeshBufferPtr rail_buf;
 
-   CurvedRailMeshMap::iterator it = curved_rail_meshes.find(base_radius);
-   if (it != curved_rail_meshes.end())
-      rail_buf = (*it).second;
-   else {
-      rail_buf = make_mesh_buffer();
+   {
+      lock_guard<mutex> lock(cache_mutex);
+
+      CurvedRailMeshMap::iterator it = curved_rail_meshes.find(base_radius);
+      if (it != curved_rail_meshes.end())
+         rail_buf = (*it).second;
+      else {
+         rail_buf = make_mesh_buffer();
 
-      generate_curved_rail_mesh(rail_buf, base_radius, INNER_RAIL);
-      generate_curved_rail_mesh(rail_buf, base_radius, OUTER_RAIL);
+         generate_curved_rail_mesh(rail_buf, base_radius, INNER_RAIL);
+         generate_curved_rail_mesh(rail_buf, base_radius, OUTER_RAIL);
 
-      curved_rail_meshes[base_radius] = rail_buf;
+         curved_rail_meshes[base_radius] = rail_buf;
+      }
    }
 
    buf->merge(rail_buf, off, y_angle);
@@ -14,13 +14,21 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
-
 #include "ITrackGraph.hpp"
 #include "ILogger.hpp"
 #include "IterateTrack.hpp"
 
 #include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <deque>
+#include <map>
+#include <set>
+#include <cmath>
 
+// Compiles the track layout into a graph by walking out along every
+// exit of every node until the next node is reached
 class TrackGraph : public ITrackGraph {
 public:
    TrackGraph(IMapPtr map);
@@ -29,60 +37,228 @@ public:
    void write_dot_file(const string& file) const;
    const graph::Node& root() const;
    const graph::Node& node(unsigned n) const;
+   unsigned node_count() const { return nodes.size(); }
 
 private:
-   void walk_track(TrackIterator it,
-                   set<ITrackSegmentPtr>& visited,
-                   graph::Node& where);
-   graph::Node& add_node(graph::NodeType type);
-   
+   // A stretch of track leaving a node which is still to be walked
+   typedef pair<unsigned, track::Connection> Departure;
+
+   // Heights sampled along the arc being walked
+   struct Profile {
+      float first_height, last_height, last_distance;
+      bool started;
+   };
+
+   void walk_arc(const Departure& departure);
+   void depart(unsigned n, const track::Connection& where);
+   void arrive(unsigned n, const TrackIterator& it);
+   bool find_node(const TrackIterator& it, IStationPtr leaving,
+                  unsigned& n);
+   void measure(const TrackIterator& it, graph::Arc& arc,
+                Profile& profile) const;
+   unsigned add_node(graph::NodeType type);
+   string node_label(const graph::Node& n) const;
+
+   static track::Connection reverse(const track::Connection& c);
+
+   IMapPtr map;
    vector<graph::Node> nodes;
+   std::map<ITrackSegmentPtr, unsigned> track_nodes;
+   std::map<IStationPtr, unsigned> station_nodes;
+   deque<Departure> pending;
+   set<Departure> walked;
+
+   // Distance between height samples when measuring gradients
+   static const float SAMPLE_STEP;
 };
 
+const float TrackGraph::SAMPLE_STEP = 0.5f;
+
 TrackGraph::TrackGraph(IMapPtr map)
+   : map(map)
 {
    track::Position p;
    track::Direction d;
    tie(p, d) = map->start();
 
-   graph::Node& root = add_node(graph::NODE_ROOT);
+   TrackIterator start = iterate_track(map, p, d);
+   if (start.status == TRACK_NO_MORE)
+      throw runtime_error("No track at the start position");
+
+   const unsigned root = add_node(graph::NODE_ROOT);
+   nodes[root].track = start.track;
+   track_nodes[start.track] = root;
+
+   arrive(root, start);
+
+   // Breadth first so a large layout cannot overflow the stack
+   while (!pending.empty()) {
+      walk_arc(pending.front());
+      pending.pop_front();
+   }
+
+   int n_arcs = 0;
+   for (auto& n : nodes)
+      n_arcs += n.arcs.size();
+
+   log() << "Track graph has " << nodes.size() << " nodes and "
+         << n_arcs << " arcs";
+}
+
+// The connection that leads back the way a train came in
+track::Connection TrackGraph::reverse(const track::Connection& c)
+{
+   track::Position pos = make_point(
+      c.first.x - c.second.x,
+      c.first.y - c.second.z);
+
+   return make_pair(pos, -c.second);
+}
 
-   set<ITrackSegmentPtr> visited;
-   walk_track(iterate_track(map, p, d), visited, root);
+void TrackGraph::depart(unsigned n, const track::Connection& where)
+{
+   Departure d = make_pair(n, where);
+   if (walked.insert(d).second)
+      pending.push_back(d);
 }
 
-void TrackGraph::walk_track(TrackIterator it,
-                            set<ITrackSegmentPtr>& visited,
-                            graph::Node& where)
+// Queue up every way out of a node for a train that has just
+// entered its track
+void TrackGraph::arrive(unsigned n, const TrackIterator& it)
 {
-   if (visited.find(it.track) != visited.end()) {
-      // TODO: connect up with arc         
+   vector<track::Connection> exits;
+   it.track->get_exits(it.token, exits);
+
+   for (auto& c : exits)
+      depart(n, c);
+
+   depart(n, reverse(make_pair(it.token.position, it.token.direction)));
+}
+
+// Follow the track from a node to the next one and add an arc
+// between them
+void TrackGraph::walk_arc(const Departure& departure)
+{
+   const unsigned from = departure.first;
+
+   graph::Arc arc = {
+      from, 0, 0.0f, departure.second, departure.second, 0.0f, 0.0f
+   };
+   Profile profile = { 0.0f, 0.0f, 0.0f, false };
+
+   // Don't stop again in the station we are leaving
+   IStationPtr leaving = nodes[from].station;
+
+   track::Connection next = departure.second;
+   TrackIterator it = iterate_track(map, next.first, next.second);
+
+   unsigned end;
+   for (;;) {
+      if (it.status == TRACK_NO_MORE) {
+         end = add_node(graph::NODE_DEAD_END);
+         break;
+      }
+
+      measure(it, arc, profile);
+
+      if (it.station != leaving)
+         leaving.reset();
+
+      if (find_node(it, leaving, end))
+         break;
+
+      next = it.track->next_position(it.token);
+      if (next == departure.second)
+         throw runtime_error("Found a loop of track with no junctions");
+
+      arc.arrival = next;
+      it = iterate_track(map, next.first, next.second);
    }
 
-   visited.insert(it.track);
+   arc.end = end;
+   arc.rise = profile.last_height - profile.first_height;
+   nodes[from].arcs.push_back(arc);
 
-   switch (it.status) {
-   case TRACK_STATION:
-      // TODO
-   case TRACK_OK:
-      walk_track(it.next(), visited, where);
-      break;
+   if (it.status == TRACK_NO_MORE)
+      depart(end, reverse(arc.arrival));
+   else
+      arrive(end, it);
+}
 
-   case TRACK_NO_MORE:
-      break;
+// Find or create the node for the track under the iterator if it
+// is somewhere a train can stop or make a choice
+bool TrackGraph::find_node(const TrackIterator& it, IStationPtr leaving,
+                           unsigned& n)
+{
+   auto t = track_nodes.find(it.track);
+   if (t != track_nodes.end()) {
+      n = (*t).second;
+      return true;
+   }
 
-   case TRACK_CHOICE:
-      throw runtime_error("can't graph track with choice yet!");
-      
+   if (it.track->has_multiple_states()) {
+      n = add_node(graph::NODE_POINTS);
+      nodes[n].track = it.track;
+      track_nodes[it.track] = n;
+      return true;
    }
+
+   if (it.station && it.station != leaving) {
+      auto s = station_nodes.find(it.station);
+      if (s != station_nodes.end())
+         n = (*s).second;
+      else {
+         n = add_node(graph::NODE_STATION);
+         nodes[n].track = it.track;
+         nodes[n].station = it.station;
+         station_nodes[it.station] = n;
+      }
+      return true;
+   }
+
+   return false;
 }
 
-graph::Node& TrackGraph::add_node(graph::NodeType type)
+// Add the length of a segment to the arc and sample its height
+void TrackGraph::measure(const TrackIterator& it, graph::Arc& arc,
+                         Profile& profile) const
+{
+   const float len = it.track->segment_length(it.token);
+   const int n = max(1, int(ceilf(len / SAMPLE_STEP)));
+
+   for (int i = 0; i <= n; i++) {
+      // The transform is only defined up to the end of the segment
+      const float delta = min(len * i / n, len * 0.999f);
+      const float height =
+         it.token.transform(delta).transform(make_vector(0.0f, 0.0f, 0.0f)).y;
+      const float distance = arc.length + delta;
+
+      if (!profile.started) {
+         profile.first_height = height;
+         profile.started = true;
+      }
+      else if (distance - profile.last_distance < 0.1f)
+         continue;
+      else {
+         const float gradient =
+            abs(height - profile.last_height)
+            / (distance - profile.last_distance);
+         arc.max_gradient = max(arc.max_gradient, gradient);
+      }
+
+      profile.last_height = height;
+      profile.last_distance = distance;
+   }
+
+   arc.length += len;
+}
+
+unsigned TrackGraph::add_node(graph::NodeType type)
 {
    unsigned id = nodes.size();
    graph::Node n = { id, type };
    nodes.push_back(n);
-   return nodes.at(id);
+   return id;
 }
    
 const graph::Node& TrackGraph::root() const
@@ -97,12 +273,61 @@ const graph::Node& TrackGraph::node(unsigned n) const
    return nodes.at(n);
 }
 
+string TrackGraph::node_label(const graph::Node& n) const
+{
+   ostringstream ss;
+
+   switch (n.type) {
+   case graph::NODE_ROOT:
+      ss << "start";
+      break;
+   case graph::NODE_STATION:
+      for (auto c : n.station->name())
+         ss << (c == '"' ? '\'' : c);
+      break;
+   case graph::NODE_POINTS:
+      ss << "points";
+      break;
+   case graph::NODE_DEAD_END:
+      return "end";
+   }
+
+   PointList endpoints;
+   n.track->get_endpoints(endpoints);
+   ss << "\\n" << endpoints.front();
+
+   return ss.str();
+}
+
 void TrackGraph::write_dot_file(const string& file) const
 {
    ofstream of(file.c_str());
    if (!of.good())
       throw runtime_error("failed to open " + file);
 
+   static const char *shapes[] = { "doublecircle", "box", "diamond", "point" };
+
+   of << "digraph track {" << endl;
+
+   for (auto& n : nodes)
+      of << "   n" << n.id << " [label=\"" << node_label(n)
+         << "\" shape=" << shapes[n.type] << "];" << endl;
+
+   of << fixed << setprecision(1);
+
+   for (auto& n : nodes) {
+      for (auto& a : n.arcs) {
+         of << "   n" << a.start << " -> n" << a.end
+            << " [label=\"" << a.length;
+         if (a.max_gradient > 0.0f)
+            of << "\\nrise " << a.rise << " max 1:"
+               << 1.0f / a.max_gradient;
+         of << "\"];" << endl;
+      }
+   }
+
+   of << "}" << endl;
+
    log() << "Wrote track graph to " << file;
 }
 
@@ -21,312 +21,634 @@
 #include "TrackCommon.hpp"
 #include "ISmokeTrail.hpp"
 #include "OpenGLHelper.hpp"
+#include "SnapshotBuffer.hpp"
+#include "ISignalling.hpp"
 
 #include <stdexcept>
 #include <cassert>
-#include <queue>
 #include <sstream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <limits>
 
-#include <boost/operators.hpp>
+namespace {
+   // How many metres does a tile correspond to?
+   const double M_PER_UNIT = 5.0;
 
-// Concrete implementation of trains
-class Train : public ITrain {
+   // Seperation between waggons
+   const double SEPARATION = 0.15;
+}
+
+// All the trains on a map
+// Each array holds one entry per part of every train with the parts of
+// a train stored together, engine first, so update can work through
+// them in order
+class TrainStore : public ITrainStore {
 public:
-   Train(IMapPtr a_map);
+   TrainStore(IMapPtr a_map);
 
-   // ITrain interface
-   void render() const;
+   // ITrainStore interface
+   ITrainPtr add_train(float a_offset);
+   int train_count() const { return first_part.size(); }
+   ITrainPtr train(int i) const { return handles.at(i); }
    void update(int a_delta);
-   VectorF front() const;
-   ITrackSegmentPtr track_segment() const;
-   track::Direction direction() const;
-   track::Position tile() const { return engine().travel_token.position; }
-   double speed() const { return parts.front().vehicle->speed(); }
-   IControllerPtr controller() { return parts.front().vehicle->controller(); }
+   void sync() { snapshots.acquire(); }
+   float tick_fraction() const;
+   void render(float a_fraction) const;
+
+   // Everything the render thread needs to know about the trains
+   struct Snapshot {
+      struct PartState {
+         IRollingStockPtr vehicle;
+         MatrixF4 last_transform, transform;
+      };
+      vector<PartState> parts;
+
+      struct TrainState {
+         int first_part, part_count;
+
+         ITrackSegmentPtr segment;
+         track::Position tile;
+         track::Direction direction;
+         double speed;
+         SignalAspect signal;
+
+         // Copy of the engine's controller state
+         int throttle;
+         bool brake_on, reverse_on, stopped;
+         double pressure, temp;
+
+         SmokeParticleList smoke;
+      };
+      vector<TrainState> trains;
+
+      // When update published this and the length of that tick in
+      // milliseconds or zero if it was not published by update
+      chrono::steady_clock::time_point published;
+      int tick_ms;
+   };
+
+   const Snapshot& snapshot() const { return snapshots.front(); }
+
+   void render_train(int a_train, float a_fraction) const;
+
+   // Queue an action for a train's engine until the next update
+   void post_action(int a_train, Action an_action);
 
 private:
-   // The different parts of the train are on different track segments
-   struct Part : boost::equality_comparable<Part> {
-      explicit Part(IRollingStockPtr a_vehicle)
-         : vehicle(a_vehicle), segment_delta(0.0), movement_sign(1.0)
-      {}
+   int add_part(int a_train, IRollingStockPtr a_vehicle);
+   void enter_segment(int a_part, const track::Connection& a_connection);
+   void move_part(int a_part, double a_distance);
+   void move_train(int a_train, double a_distance);
+   void update_smoke_position(int a_train, int a_delta);
+   void check_signal(int a_train);
+   bool train_ahead_in_block(int a_train, int a_next_block,
+                             float a_remaining, float& a_gap) const;
+   MatrixF4 part_transform(int a_part) const;
+   VectorF part_position(int a_part) const;
+   void publish(int a_delta);
+   void apply_actions();
+
+   static track::Connection reverse_token(const track::TravelToken& token);
+
+   IMapPtr map;
+   ISignallingPtr signalling;
+
+   // Hot per-part state touched by every update
+   vector<int> part_train;           // Index of the owning train
+   vector<float> segment_delta;      // Distance along the segment
+   vector<float> movement_sign;      // Handles reversal mid-segment
+   vector<double> mass;
+   vector<track::TravelToken> travel_token;
+   vector<track::Direction> direction;
+   vector<int> block;                // Signal block of the segment
+
+   // Colder per-part state
+   vector<IRollingStockPtr> vehicle;
+   vector<ITrackSegmentPtr> segment;
+   vector<MatrixF4> last_transform;  // Value of part_transform
+                                     // before the last update
+
+   // Per-train state
+   vector<int> first_part, part_count;
+   vector<double> speed;
+   vector<double> gravity;
+   vector<VectorF> velocity;
+   vector<SignalAspect> signal;
+   vector<ISmokeTrailPtr> smoke_trail;
+   vector<ITrainPtr> handles;
+
+   SnapshotBuffer<Snapshot> snapshots;
+
+   // Actions from the controls waiting for the next update
+   mutex actions_mutex;
+   vector<pair<int, Action> > pending_actions;
+};
+
+// A single train in a store which reads from its last snapshot
+// Only valid while the store exists
+class Train : public ITrain {
+public:
+   Train(TrainStore& a_store, int a_index);
 
-      IRollingStockPtr vehicle;
+   // ITrain interface
+   void render(float a_fraction) const;
+   VectorF front(float a_fraction) const;
+   ITrackSegmentPtr track_segment() const { return state().segment; }
+   track::Direction direction() const { return state().direction; }
+   track::Position tile() const { return state().tile; }
+   double speed() const { return state().speed; }
+   SignalAspect signal_aspect() const { return state().signal; }
+   IControllerPtr controller() { return controls; }
 
-      // The length of a track segment can be found by calling
-      // segment_length() This delta value ranges from 0 to that length and
-      // indicates how far along the segment the train is
-      ITrackSegmentPtr segment;
-      float segment_delta;
-      track::TravelToken travel_token;
+private:
+   typedef TrainStore::Snapshot Snapshot;
 
-      // Direction train part is travelling along the track
-      Vector<int> direction;
+   const Snapshot::TrainState& state() const
+   {
+      return store.snapshot().trains.at(index);
+   }
 
-      // Handles reversal mid-segment
-      float movement_sign;
+   // Controller handed out to the user interface
+   class Controls : public IController {
+   public:
+      explicit Controls(Train& a_train) : train(a_train) {}
 
-      bool operator==(const Part& other) const
+      void act_on(Action an_action)
       {
-         return this == &other;
+         train.store.post_action(train.index, an_action);
       }
+
+      int throttle() const { return train.state().throttle; }
+      bool brake_on() const { return train.state().brake_on; }
+      bool reverse_on() const { return train.state().reverse_on; }
+      double pressure() const { return train.state().pressure; }
+      double temp() const { return train.state().temp; }
+      bool stopped() const { return train.state().stopped; }
+
+   private:
+      Train& train;
    };
-   list<Part> parts;
 
-   const Part& engine() const;
-   Part& engine();
-   void move(double a_distance);
-   void add_part(IRollingStockPtr a_vehicle);
-   VectorF part_position(const Part& a_part) const;
-   void update_smoke_position(int a_delta);
-   void move_part(Part& part, double distance);
+   TrainStore& store;
+   const int index;
+   IControllerPtr controls;
+};
 
-   static track::Connection reverse_token(const track::TravelToken& token);
-   static void transform_to_part(const Part& p);
+Train::Train(TrainStore& a_store, int a_index)
+   : store(a_store), index(a_index), controls(new Controls(*this))
+{
 
-   IMapPtr map;
-   ISmokeTrailPtr smoke_trail;
+}
 
-   VectorF velocity_vector;
+void Train::render(float a_fraction) const
+{
+   store.render_train(index, a_fraction);
+}
 
-   // Move part of the train across a connection
-   void enter_segment(Part& a_part, const track::Connection& a_connection);
+VectorF Train::front(float a_fraction) const
+{
+   const Snapshot& s = store.snapshot();
+   const Snapshot::PartState& e = s.parts.at(s.trains.at(index).first_part);
 
-   // Seperation between waggons
-   static const double SEPARATION;
-};
+   const VectorF origin = make_vector(0.0f, 0.0f, 0.0f);
+   const VectorF last = e.last_transform.transform(origin);
+   const VectorF now = e.transform.transform(origin);
 
-const double Train::SEPARATION(0.15);
+   return last + (now - last) * a_fraction;
+}
 
-Train::Train(IMapPtr a_map)
-   : map(a_map), velocity_vector(make_vector(0.0f, 0.0f, 0.0f))
+TrainStore::TrainStore(IMapPtr a_map)
+   : map(a_map), signalling(make_signalling(a_map))
 {
-   parts.push_front(Part(load_engine("tank")));
 
-   enter_segment(engine(), a_map->start());
+}
+
+// Trains may only be added before the simulation starts
+ITrainPtr TrainStore::add_train(float a_offset)
+{
+   const int t = first_part.size();
+
+   first_part.push_back(vehicle.size());
+   part_count.push_back(0);
+   speed.push_back(0.0);
+   gravity.push_back(0.0);
+   velocity.push_back(make_vector(0.0f, 0.0f, 0.0f));
+   signal.push_back(SIGNAL_CLEAR);
+
+   add_part(t, load_engine("tank"));
 
    // Bit of a hack to put the engine in the right place
-   move(0.275);
+   move_train(t, 0.275);
 
 #if 1
-   for (int i = 1; i <= 4; i++)
-      add_part(load_waggon("coal_truck"));
+   for (int i = 1; i <= 4; i++) {
+      const int p = add_part(t, load_waggon("coal_truck"));
+
+      // Push the rest of the train along some
+      for (int q = first_part[t]; q < p; q++)
+         move_part(q, vehicle[p]->length() + SEPARATION);
+   }
 #endif
 
-   smoke_trail = make_smoke_trail();
-}
+   move_train(t, a_offset);
 
-void Train::add_part(IRollingStockPtr a_vehicle)
-{
-   Part part(a_vehicle);
-   enter_segment(part, map->start());
+   smoke_trail.push_back(make_smoke_trail());
+   handles.push_back(ITrainPtr(new Train(*this, t)));
 
-   // Push the rest of the train along some
-   move(part.vehicle->length() + SEPARATION);
+   for (int p = first_part[t]; p < first_part[t] + part_count[t]; p++)
+      last_transform[p] = part_transform(p);
 
-   parts.push_back(part);
-}
+   publish(0);
+   sync();
 
-Train::Part& Train::engine()
-{
-   assert(parts.size() > 0);
-   return parts.front();
+   return handles.back();
 }
 
-const Train::Part& Train::engine() const
+// Parts are appended so this must be the last train added
+int TrainStore::add_part(int a_train, IRollingStockPtr a_vehicle)
 {
-   assert(parts.size() > 0);
-   return parts.front();
+   assert(a_train == int(first_part.size()) - 1);
+
+   const int p = vehicle.size();
+
+   part_train.push_back(a_train);
+   segment_delta.push_back(0.0f);
+   movement_sign.push_back(1.0f);
+   mass.push_back(a_vehicle->mass());
+   travel_token.push_back(track::TravelToken());
+   direction.push_back(track::Direction());
+   block.push_back(ISignalling::NO_BLOCK);
+   vehicle.push_back(a_vehicle);
+   segment.push_back(ITrackSegmentPtr());
+   last_transform.push_back(MatrixF4::identity());
+
+   part_count[a_train]++;
+
+   // New parts start at the beginning of the line behind the rest
+   // of the train
+   enter_segment(p, map->start());
+
+   return p;
 }
 
-void Train::move_part(Part& part, double distance)
+void TrainStore::move_part(int p, double distance)
 {
    // Never move in units greater than 1.0
    double d = abs(distance);
-   double sign = (distance >= 0.0 ? 1.0 : -1.0) * part.movement_sign;
+   double sign = (distance >= 0.0 ? 1.0 : -1.0) * movement_sign[p];
    const double step = 0.25;
 
-   //debug() << "move d=" << distance << " s=" << sign
-   //        << " ms=" << part.movement_sign;
-
    do {
-      part.segment_delta += min(step, d) * sign;
+      segment_delta[p] += min(step, d) * sign;
 
       const double segment_length =
-         part.segment->segment_length(part.travel_token);
-      if (part.segment_delta >= segment_length) {
+         segment[p]->segment_length(travel_token[p]);
+      if (segment_delta[p] >= segment_length) {
          // Moved onto a new piece of track
-         const double over = part.segment_delta - segment_length;
-         enter_segment(part, part.segment->next_position(part.travel_token));
-         part.segment_delta = over;
+         const double over = segment_delta[p] - segment_length;
+         enter_segment(p, segment[p]->next_position(travel_token[p]));
+         segment_delta[p] = over;
       }
-      else if (part.segment_delta < 0.0) {
-         track::Connection prev = reverse_token(part.travel_token);
-         enter_segment(part, prev);
-         part.segment_delta *= -1.0;
-         part.movement_sign *= -1.0;
+      else if (segment_delta[p] < 0.0) {
+         track::Connection prev = reverse_token(travel_token[p]);
+         enter_segment(p, prev);
+         segment_delta[p] *= -1.0;
+         movement_sign[p] *= -1.0;
       }
 
       d -= step;
    } while (d > 0.0);
 }
 
-// Move the train along the line a bit
-void Train::move(double a_distance)
+// Move every part of one train along the line a bit
+void TrainStore::move_train(int t, double a_distance)
 {
-   using namespace placeholders;
-
-   for (list<Part>::iterator it = parts.begin();
-        it != parts.end(); ++it)
-      move_part(*it, a_distance);
+   for (int p = first_part[t]; p < first_part[t] + part_count[t]; p++)
+      move_part(p, a_distance);
 }
 
-void Train::update_smoke_position(int a_delta)
+void TrainStore::update_smoke_position(int t, int a_delta)
 {
-   const Part& e = engine();
-   glPushMatrix();
-   glLoadIdentity();
-
-   transform_to_part(e);
+   const int e = first_part[t];
 
    const float smoke_offX = 0.63f;
    const float smoke_offY = 1.04f;
-   glTranslatef(smoke_offX, smoke_offY, 0.0f);
-
-   float matrix[16];
-   glGetFloatv(GL_MODELVIEW_MATRIX, matrix);
-
-   glPopMatrix();
+   const VectorF smoke_pos = part_transform(e).transform(
+      make_vector(smoke_offX, smoke_offY, 0.0f));
 
-   smoke_trail->set_position(matrix[12], matrix[13], matrix[14]);
-   smoke_trail->set_velocity(
-      velocity_vector.x,
-      velocity_vector.y,
-      velocity_vector.z);
-   smoke_trail->update(a_delta);
+   ISmokeTrailPtr smoke = smoke_trail[t];
+   smoke->set_position(smoke_pos.x, smoke_pos.y, smoke_pos.z);
+   smoke->set_velocity(velocity[t].x, velocity[t].y, velocity[t].z);
+   smoke->update(a_delta);
 
    // Make the rate at which new particles are created proportional
    // to the throttle of the controller
-   const int throttle = e.vehicle->controller()->throttle();
+   const int throttle = vehicle[e]->controller()->throttle();
    const int base_delay = 200;
 
-   smoke_trail->set_delay(base_delay - (throttle * 15));
+   smoke->set_delay(base_delay - (throttle * 15));
 }
 
-void Train::update(int delta)
+void TrainStore::update(int delta)
 {
-   double gravity_sum = 0.0;
-   for (list<Part>::iterator it = parts.begin();
-        it != parts.end(); ++it) {
-      float gradient = (*it).travel_token.gradient((*it).segment_delta);
+   apply_actions();
+
+   const int n_parts = vehicle.size();
+   const int n_trains = first_part.size();
+
+   for (int p = 0; p < n_parts; p++)
+      last_transform[p] = part_transform(p);
+
+   // Sum the pull of gravity on each train
+   fill(gravity.begin(), gravity.end(), 0.0);
+   for (int p = 0; p < n_parts; p++) {
+      float gradient = travel_token[p].gradient(segment_delta[p]);
 
-      if ((*it).direction.x < 0 || (*it).direction.z < 0)
+      if (direction[p].x < 0 || direction[p].z < 0)
          gradient *= -1.0f;
 
-      gradient *= (*it).movement_sign;
+      gradient *= movement_sign[p];
 
       const double g = 9.78;
-      gravity_sum += -g * gradient * (*it).vehicle->mass();
+      gravity[part_train[p]] += -g * gradient * mass[p];
    }
 
-   for (list<Part>::iterator it = parts.begin();
-        it != parts.end(); ++it)
-      (*it).vehicle->update(delta, gravity_sum);
+   for (int t = 0; t < n_trains; t++)
+      check_signal(t);
 
-   update_smoke_position(delta);
+   for (int p = 0; p < n_parts; p++)
+      vehicle[p]->update(delta, gravity[part_train[p]]);
 
-   // How many metres does a tile correspond to?
-   const double M_PER_UNIT = 5.0;
-
-   const VectorF old_pos = part_position(engine());
+   for (int t = 0; t < n_trains; t++) {
+      update_smoke_position(t, delta);
+      speed[t] = vehicle[first_part[t]]->speed();
+   }
 
    const double delta_seconds = static_cast<float>(delta) / 1000.0f;
-   move(engine().vehicle->speed() * delta_seconds / M_PER_UNIT);
 
-   velocity_vector = part_position(engine()) - old_pos;
+   for (int t = 0; t < n_trains; t++) {
+      const VectorF old_pos = part_position(first_part[t]);
+
+      move_train(t, speed[t] * delta_seconds / M_PER_UNIT);
+
+      velocity[t] = part_position(first_part[t]) - old_pos;
+   }
+
+   publish(delta);
 }
 
-// Called when the train enters a new segment
+// Called when a part enters a new segment
 // Resets the delta and gets the length of the new segment
-void Train::enter_segment(Part& a_part, const track::Connection& a_connection)
+void TrainStore::enter_segment(int p, const track::Connection& a_connection)
 {
    PointI pos;
-   tie(pos, a_part.direction) = a_connection;
-
-#if 0
-   debug() << "Train part entered segment at " << pos
-           << " moving " << a_part.direction;
-#endif
+   tie(pos, direction[p]) = a_connection;
 
    if (!map->is_valid_track(pos))
       throw runtime_error("Train fell off end of track!");
 
-   a_part.segment_delta = 0.0;
-   a_part.segment = map->track_at(pos);
-   a_part.travel_token = a_part.segment->get_travel_token(pos, a_part.direction);
+   segment_delta[p] = 0.0;
+   segment[p] = map->track_at(pos);
+   travel_token[p] = segment[p]->get_travel_token(pos, direction[p]);
+
+   const int b = signalling->block_of(segment[p]);
+   if (b != block[p]) {
+      signalling->leave_block(block[p], part_train[p]);
+      signalling->enter_block(b, part_train[p]);
+      block[p] = b;
+   }
+}
+
+// Tell the engine about the signal protecting the next block
+// Signals only apply to trains running engine first
+void TrainStore::check_signal(int t)
+{
+   const int e = first_part[t];
+
+   SignalAspect aspect = SIGNAL_CLEAR;
+   double distance = 0.0;
+
+   if (movement_sign[e] > 0.0f && vehicle[e]->speed() >= 0.0) {
+      float ahead;
+      const int b =
+         signalling->block_ahead(segment[e], travel_token[e], ahead);
+
+      const float remaining = ahead - segment_delta[e];
+
+      aspect = signalling->aspect(b, t);
+      distance = remaining * M_PER_UNIT;
+
+      // No signal protects a train already inside the same block
+      float gap;
+      if (train_ahead_in_block(t, b, remaining, gap)
+          && (aspect == SIGNAL_CLEAR || gap * M_PER_UNIT < distance)) {
+         aspect = SIGNAL_DANGER;
+         distance = gap * M_PER_UNIT;
+      }
+   }
+
+   signal[t] = aspect;
+   vehicle[e]->signal_ahead(aspect, distance, gravity[t]);
 }
 
-void Train::transform_to_part(const Part& p)
+// Find the nearest part of another train between the front of this
+// one and the end of its current block, such as when several trains
+// are added to one stretch of plain track
+// A part heading for a different block is coming the other way so is
+// treated as right in front
+bool TrainStore::train_ahead_in_block(int t, int next_block,
+                                      float remaining, float& gap) const
 {
-   p.travel_token.transform(p.segment_delta);
+   const int e = first_part[t];
+   const int b = block[e];
+
+   // The block is only shared if it is at danger from inside
+   if (b == ISignalling::NO_BLOCK
+       || signalling->aspect(b, t) == SIGNAL_CLEAR)
+      return false;
+
+   bool found = false;
+   gap = numeric_limits<float>::max();
+
+   const int n_parts = vehicle.size();
+   for (int p = 0; p < n_parts; p++) {
+      if (block[p] != b || part_train[p] == t)
+         continue;
+
+      float ahead;
+      float g = 0.0f;
+      if (signalling->block_ahead(segment[p], travel_token[p], ahead)
+          == next_block)
+         g = remaining - (ahead - segment_delta[p])
+            - (vehicle[e]->length() + vehicle[p]->length()) / 2.0f;
+
+      if (g < -vehicle[p]->length())
+         continue;   // Behind this train
+
+      if (g < gap) {
+         gap = max(0.0f, g);
+         found = true;
+      }
+   }
+
+   return found;
+}
+
+// The location and orientation of a part in world space
+MatrixF4 TrainStore::part_transform(int p) const
+{
+   MatrixF4 m = travel_token[p].transform(segment_delta[p]);
 
    // If we're going backwards, flip the train around
-   if (p.movement_sign < 0.0)
-      glRotatef(180.0f, 0.0f, 1.0f, 0.0f);
+   if (movement_sign[p] < 0.0)
+      m *= MatrixF4::rotation(180.0f, MatrixF4::AXIS_Y);
+
+   return m;
 }
 
-void Train::render() const
+// Calculate the position of any train part
+VectorF TrainStore::part_position(int p) const
 {
-   for (list<Part>::const_iterator it = parts.begin();
-        it != parts.end(); ++it) {
-      glPushMatrix();
+   // Call the transformer to compute the world location
+   const MatrixF4 m = travel_token[p].transform(segment_delta[p]);
+   return m.transform(make_vector(0.0f, 0.0f, 0.0f));
+}
 
-      transform_to_part(*it);
-      glTranslatef(0.0f, track::RAIL_HEIGHT, 0.0f);
+// Copy the state of the trains into the next snapshot
+void TrainStore::publish(int a_delta)
+{
+   Snapshot& s = snapshots.back();
 
-      (*it).vehicle->render();
+   const int n_parts = vehicle.size();
+   const int n_trains = first_part.size();
 
-      glPopMatrix();
+   s.parts.resize(n_parts);
+   for (int p = 0; p < n_parts; p++) {
+      Snapshot::PartState& ps = s.parts[p];
+      ps.vehicle = vehicle[p];
+      ps.last_transform = last_transform[p];
+      ps.transform = part_transform(p);
    }
 
-   smoke_trail->render();
+   s.trains.resize(n_trains);
+   for (int t = 0; t < n_trains; t++) {
+      Snapshot::TrainState& ts = s.trains[t];
+      const int e = first_part[t];
+
+      ts.first_part = e;
+      ts.part_count = part_count[t];
+      ts.segment = segment[e];
+      ts.tile = travel_token[e].position;
+      ts.direction = direction[e];
+      ts.speed = vehicle[e]->speed();
+      ts.signal = signal[t];
+
+      IControllerPtr ctrl = vehicle[e]->controller();
+      ts.throttle = ctrl->throttle();
+      ts.brake_on = ctrl->brake_on();
+      ts.reverse_on = ctrl->reverse_on();
+      ts.stopped = ctrl->stopped();
+      ts.pressure = ctrl->pressure();
+      ts.temp = ctrl->temp();
+
+      smoke_trail[t]->get_particles(ts.smoke);
+   }
+
+   s.published = chrono::steady_clock::now();
+   s.tick_ms = a_delta;
+
+   snapshots.publish();
 }
 
-ITrackSegmentPtr Train::track_segment() const
+// Taken from the snapshot itself so the fraction always matches the
+// transforms being drawn
+float TrainStore::tick_fraction() const
 {
-   return engine().segment;
+   const Snapshot& s = snapshots.front();
+   if (s.tick_ms <= 0)
+      return 1.0f;
+
+   const chrono::duration<float, milli> since =
+      chrono::steady_clock::now() - s.published;
+
+   return min(1.0f, since.count() / s.tick_ms);
 }
 
-VectorF Train::front() const
+void TrainStore::post_action(int a_train, Action an_action)
 {
-   return part_position(engine());
+   lock_guard<mutex> lock(actions_mutex);
+   pending_actions.push_back(make_pair(a_train, an_action));
 }
 
-track::Direction Train::direction() const
+// Pass on actions from the controls to the engines
+void TrainStore::apply_actions()
 {
-   return engine().direction;
+   vector<pair<int, Action> > actions;
+   {
+      lock_guard<mutex> lock(actions_mutex);
+      actions.swap(pending_actions);
+   }
+
+   for (vector<pair<int, Action> >::iterator it = actions.begin();
+        it != actions.end(); ++it)
+      vehicle[first_part[(*it).first]]->controller()->act_on((*it).second);
 }
 
-// Calculate the position of any train part
-VectorF Train::part_position(const Part& a_part) const
+// Blend between two part transforms
+// A part that has just reversed is not blended as it would shrink
+// through zero as it turned around
+static MatrixF4 interpolate(const MatrixF4& from, const MatrixF4& to,
+                            float f)
 {
-   // Call the transformer to compute the world location
-   glPushMatrix();
-   glLoadIdentity();
+   const float facing = from.entries[0][0] * to.entries[0][0]
+      + from.entries[1][0] * to.entries[1][0]
+      + from.entries[2][0] * to.entries[2][0];
+   if (facing < 0.0f)
+      return to;
+
+   MatrixF4 m;
+   for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++)
+         m.entries[i][j] = from.entries[i][j]
+            + (to.entries[i][j] - from.entries[i][j]) * f;
+   }
+   return m;
+}
+
+void TrainStore::render_train(int a_train, float a_fraction) const
+{
+   const Snapshot& s = snapshots.front();
+   const Snapshot::TrainState& ts = s.trains.at(a_train);
+
+   for (int p = ts.first_part; p < ts.first_part + ts.part_count; p++) {
+      const Snapshot::PartState& ps = s.parts[p];
+
+      glPushMatrix();
 
-   a_part.travel_token.transform(a_part.segment_delta);
+      gl::mult_matrix(interpolate(ps.last_transform, ps.transform,
+                                  a_fraction));
+      glTranslatef(0.0f, track::RAIL_HEIGHT, 0.0f);
 
-   float matrix[16];
-   glGetFloatv(GL_MODELVIEW_MATRIX, matrix);
+      ps.vehicle->render();
 
-   glPopMatrix();
+      glPopMatrix();
+   }
 
-   return make_vector(matrix[12], matrix[13], matrix[14]);
+   smoke_trail.at(a_train)->render(ts.smoke);
+}
+
+void TrainStore::render(float a_fraction) const
+{
+   const int n_trains = snapshots.front().trains.size();
+   for (int t = 0; t < n_trains; t++)
+      render_train(t, a_fraction);
 }
 
 // Compute a connection object that reverses the train's
 // direction of travel
-track::Connection Train::reverse_token(const track::TravelToken& token)
+track::Connection TrainStore::reverse_token(const track::TravelToken& token)
 {
    track::Position pos = make_point(
       token.position.x - token.direction.x,
@@ -337,8 +659,7 @@ track::Connection Train::reverse_token(const track::TravelToken& token)
    return make_pair(pos, dir);
 }
 
-// Make an empty train
-ITrainPtr make_train(IMapPtr a_map)
+ITrainStorePtr make_train_store(IMapPtr a_map)
 {
-   return ITrainPtr(new Train(a_map));
+   return ITrainStorePtr(new TrainStore(a_map));
 }
@@ -42,6 +42,7 @@ public:
    void merge(IMeshBufferPtr buf);
    Point<int> size() const;
    IIndustryPtr industry() const;
+   SceneryRef reference() const;
 
    // IXMLCallback interface
    void text(const string& local_name, const string& content);
@@ -131,6 +132,12 @@ xml::element Tree::to_xml() const
       .add_attribute("name", name_);
 }
 
+SceneryRef Tree::reference() const
+{
+   SceneryRef ref = { SceneryRef::TREE, name_, angle };
+   return ref;
+}
+
 static Tree* load_tree_xml(IResourcePtr res)
 {
    log() << "Loading tree from " << res->xml_file_name();
@@ -138,10 +145,20 @@ static Tree* load_tree_xml(IResourcePtr res)
    return new Tree(res);
 }
 
-static shared_ptr<Tree> load_tree_fromCache(const string& name)
+static ResourceCache<Tree>& tree_cache()
 {
    static ResourceCache<Tree> cache(load_tree_xml, "trees");
-   return cache.load_copy(name);
+   return cache;
+}
+
+static shared_ptr<Tree> load_tree_fromCache(const string& name)
+{
+   return tree_cache().load_copy(name);
+}
+
+bool prefetch_tree(const string& name)
+{
+   return ResourceCache<Tree>::is_ready(tree_cache().load_async(name));
 }
 
 ISceneryPtr load_tree(const string& name)
@@ -155,6 +172,14 @@ ISceneryPtr load_tree(const string& name)
    return ISceneryPtr(tree);
 }
 
+ISceneryPtr load_tree(const string& name, float angle)
+{
+   shared_ptr<Tree> tree = load_tree_fromCache(name);
+   tree->set_angle(angle);
+
+   return ISceneryPtr(tree);
+}
+
 ISceneryPtr load_tree(const AttributeSet& attrs)
 {
    // Unserialise a tree
@@ -163,8 +188,5 @@ ISceneryPtr load_tree(const AttributeSet& attrs)
    attrs.get("name", name);
    attrs.get("angle", angle);
 
-   shared_ptr<Tree> tree = load_tree_fromCache(name);
-   tree->set_angle(angle);
-
-   return ISceneryPtr(tree);
+   return load_tree(name, angle);
 }
@@ -30,6 +30,7 @@ public:
     void display(IGraphicsPtr a_context) const {}
     void overlay() const;
     void update(IPickBufferPtr a_pick_buffer, int a_delta) {}
+    void interpolate(float a_fraction) {}
     void on_key_down(SDLKey a_key) {}
     void on_key_up(SDLKey a_key) {}
     void on_mouse_move(IPickBufferPtr a_pick_buffer, int x, int y,
@@ -32,8 +32,13 @@ public:
    Waggon(IResourcePtr a_res);
    ~Waggon() {}
 
+   // Compile the mesh which must happen on the render thread
+   void cache_model() { model->cache(); }
+
    // IRollingStock interface
    void update(int delta, double gravity);
+   void signal_ahead(SignalAspect aspect, double distance,
+                     double gravity) {}
    void render() const;
    IControllerPtr controller();
    double speed() const { return 0.0; }
@@ -68,10 +73,8 @@ ICargoPtr Waggon::cargo() const
 // Load information from the XML file
 void Waggon::text(const string& local_name, const string& a_string)
 {
-   if (local_name == "model") {
+   if (local_name == "model")
       model = load_model(resource, a_string, MODEL_SCALE);
-      model->cache();
-   }
 }
 
 void Waggon::update(int delta, double gravity)
@@ -100,6 +103,9 @@ static Waggon* load_waggon_xml(IResourcePtr a_res)
 IRollingStockPtr load_waggon(const string& a_res_id)
 {
    static ResourceCache<Waggon> cache(load_waggon_xml, "waggons");
-   return cache.load_copy(a_res_id);
+
+   shared_ptr<Waggon> waggon = cache.load_copy(a_res_id);
+   waggon->cache_model();
+   return waggon;
 }
 
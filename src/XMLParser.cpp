@@ -20,6 +20,7 @@
 
 #include <stdexcept>
 #include <sstream>
+#include <mutex>
 
 #include <xercesc/sax2/DefaultHandler.hpp>
 #include <xercesc/sax2/XMLReaderFactory.hpp>
@@ -89,16 +90,24 @@ private:
    SAX2XMLReader* my_reader;
    SAX2WrapperHandler* my_handler;
 
+   // A reader can only parse one file at a time but parsers for
+   // different schemas may be used from different threads
+   mutex my_mutex;
+
    static int our_parser_count;
+   static mutex our_init_mutex;
 };
 
 // Number of parsers in use
 int XercesXMLParser::our_parser_count(0);
+mutex XercesXMLParser::our_init_mutex;
 
 XercesXMLParser::XercesXMLParser(const string& a_schema_file)
 {
    log() << "Creating parser for XML schema " << a_schema_file;
 
+   lock_guard<mutex> lock(our_init_mutex);
+
    if (our_parser_count++ == 0) {
       // Initialise Xerces for the first time
       try {
@@ -167,6 +176,8 @@ XercesXMLParser::~XercesXMLParser()
 
 void XercesXMLParser::parse(const string& a_file_name, IXMLCallback& a_callback)
 {
+   lock_guard<mutex> lock(my_mutex);
+
    my_handler->callback_ptr = &a_callback;
 
    try {
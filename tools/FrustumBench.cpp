@@ -0,0 +1,151 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Maths.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+#include <ctime>
+
+//
+// Compare culling boxes one at a time against the batched SSE test
+//
+// Usage: FrustumBench [boxes] [rounds]
+//
+
+// A frustum at the origin looking down -z with the game's default
+// field of view and clip distances
+static Frustum make_test_frustum()
+{
+   const float half_fov = 45.0f * M_PI / 360.0f;
+   const float c = cosf(half_fov);
+   const float s = sinf(half_fov);
+   const float near_clip = 0.1f;
+   const float far_clip = 70.0f;
+
+   const float planes[6][4] = {
+      { -c,    0.0f, -s,    0.0f },        // Right
+      { c,     0.0f, -s,    0.0f },        // Left
+      { 0.0f,  c,    -s,    0.0f },        // Bottom
+      { 0.0f,  -c,   -s,    0.0f },        // Top
+      { 0.0f,  0.0f, 1.0f,  far_clip },    // Back
+      { 0.0f,  0.0f, -1.0f, -near_clip }   // Front
+   };
+
+   Frustum f;
+   for (int i = 0; i < 6; i++) {
+      for (int j = 0; j < 4; j++)
+         f.planes[i][j] = planes[i][j];
+   }
+   return f;
+}
+
+static float random_float(float lo, float hi)
+{
+   return lo + (hi - lo) * (float(rand()) / float(RAND_MAX));
+}
+
+static double seconds_since(clock_t start)
+{
+   return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static bool is_set(const vector<unsigned>& mask, size_t i)
+{
+   return (mask[i / 32] >> (i % 32)) & 1;
+}
+
+int main(int argc, char **argv)
+{
+   const size_t n_boxes = argc > 1 ? atoi(argv[1]) : 4096;
+   const int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+
+   const Frustum frustum = make_test_frustum();
+
+   // Boxes the size of quad tree leaves scattered around the camera
+   vector<Vector<float> > lo(n_boxes), hi(n_boxes);
+   for (size_t i = 0; i < n_boxes; i++) {
+      const Vector<float> centre =
+         make_vector(random_float(-80.0f, 80.0f),
+                     random_float(-5.0f, 5.0f),
+                     random_float(-80.0f, 80.0f));
+      const Vector<float> half =
+         make_vector(4.0f, random_float(0.5f, 4.0f), 4.0f);
+
+      lo[i] = centre - half;
+      hi[i] = centre + half;
+   }
+
+   vector<unsigned> cuboid((n_boxes + 31) / 32);
+   vector<unsigned> single((n_boxes + 31) / 32);
+   vector<unsigned> batch((n_boxes + 31) / 32);
+
+   // The original test evaluates all eight corners against each plane
+   Frustum copy = frustum;
+   clock_t start = clock();
+   for (int r = 0; r < rounds; r++) {
+      fill(cuboid.begin(), cuboid.end(), 0u);
+      for (size_t i = 0; i < n_boxes; i++) {
+         const Vector<float> c = (lo[i] + hi[i]) * 0.5f;
+         const Vector<float> h = (hi[i] - lo[i]) * 0.5f;
+         if (copy.cuboid_in_frustum(c.x, c.y, c.z, h.x, h.y, h.z))
+            cuboid[i / 32] |= 1u << (i % 32);
+      }
+   }
+   const double cuboid_time = seconds_since(start);
+
+   start = clock();
+   for (int r = 0; r < rounds; r++) {
+      fill(single.begin(), single.end(), 0u);
+      for (size_t i = 0; i < n_boxes; i++) {
+         unsigned planes = Frustum::ALL_PLANES;
+         if (frustum.box_in_frustum(lo[i], hi[i], planes) != Frustum::OUTSIDE)
+            single[i / 32] |= 1u << (i % 32);
+      }
+   }
+   const double single_time = seconds_since(start);
+
+   start = clock();
+   for (int r = 0; r < rounds; r++)
+      frustum.boxes_in_frustum(&lo[0], &hi[0], n_boxes, &batch[0]);
+   const double batch_time = seconds_since(start);
+
+   size_t n_visible = 0;
+   for (size_t i = 0; i < n_boxes; i++) {
+      assert(is_set(cuboid, i) == is_set(batch, i));
+      assert(is_set(single, i) == is_set(batch, i));
+      n_visible += is_set(batch, i);
+   }
+
+   const double tests = double(n_boxes) * rounds;
+
+   cout << n_boxes << " boxes, " << n_visible << " visible, "
+        << rounds << " rounds" << endl
+        << "   cuboid_in_frustum " << cuboid_time * 1e9 / tests
+        << "ns/box" << endl
+        << "   box_in_frustum    " << single_time * 1e9 / tests
+        << "ns/box" << endl
+        << "   boxes_in_frustum  " << batch_time * 1e9 / tests
+        << "ns/box";
+   if (batch_time > 0.0)
+      cout << "   (" << cuboid_time / batch_time << "x)";
+   cout << endl;
+
+   return 0;
+}
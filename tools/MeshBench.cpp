@@ -0,0 +1,310 @@
+//
+//  Copyright (C) 2014  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "IMesh.hpp"
+#include "IConfig.hpp"
+#include "Maths.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cassert>
+#include <stdexcept>
+#include <ctime>
+
+#include <boost/cstdint.hpp>
+
+//
+// Compare the hashed vertex welding in MeshBuffer::add against the
+// original linear scan over every index in the chunk and report the
+// size of the resulting vertex data
+//
+// Usage: MeshBench [map.bin] [model.obj ...]
+//
+
+namespace {
+   const int SECTOR_SIZE = 8;   // Same as the quad tree leaf size
+
+   // Sizes of VertexData and PackedVertexData in Mesh.cpp
+   const size_t UNPACKED_VERTEX_SIZE = 64;
+   const size_t PACKED_VERTEX_SIZE = 32;
+}
+
+// Meshes are never compiled here so the config file is not needed
+IConfigPtr get_config()
+{
+   throw runtime_error("No config in MeshBench");
+}
+
+// The old implementation of MeshBuffer::add
+class LinearBuffer {
+public:
+   LinearBuffer() : reused(0) {}
+
+   void add(const IMeshBuffer::Vertex& vertex,
+            const IMeshBuffer::Normal& normal,
+            const Colour& colour,
+            const IMeshBuffer::TexCoord& tex_coord)
+   {
+      for (auto& it : indices) {
+         if (vertex == vertices[it] && normal == normals[it]) {
+            const IMeshBuffer::TexCoord& tc = tex_coords[it];
+            const bool same_tc = (approx_equal(tc.x, tex_coord.x)
+                                  && approx_equal(tc.y, tex_coord.y));
+
+            const Colour& c = colours[it];
+            const bool same_col = (approx_equal(c.r, colour.r)
+                                   && approx_equal(c.g, colour.g)
+                                   && approx_equal(c.b, colour.b));
+
+            if (same_col && same_tc) {
+               indices.push_back(it);
+               reused++;
+               return;
+            }
+         }
+      }
+
+      indices.push_back(vertices.size());
+      vertices.push_back(vertex);
+      normals.push_back(normal);
+      colours.push_back(colour);
+      tex_coords.push_back(tex_coord);
+   }
+
+   size_t vertex_count() const { return vertices.size(); }
+
+private:
+   vector<IMeshBuffer::Vertex> vertices;
+   vector<IMeshBuffer::Normal> normals;
+   vector<Colour> colours;
+   vector<IMeshBuffer::Index> indices;
+   vector<IMeshBuffer::TexCoord> tex_coords;
+   int reused;
+};
+
+// A single call to add
+struct Input {
+   IMeshBuffer::Vertex vertex;
+   IMeshBuffer::Normal normal;
+   IMeshBuffer::TexCoord tex_coord;
+};
+
+typedef vector<Input> InputList;
+
+// Generate the same sequence of vertices as Map::build_mesh
+static vector<InputList> terrain_inputs(const string& file_name)
+{
+   ifstream is(file_name.c_str(), ios::binary);
+   if (!is.good())
+      throw runtime_error("Cannot open " + file_name);
+
+   int32_t width, depth;
+   is.read(reinterpret_cast<char*>(&width), sizeof(int32_t));
+   is.read(reinterpret_cast<char*>(&depth), sizeof(int32_t));
+
+   const int row = width + 1;
+
+   vector<VectorF> pos((width + 1) * (depth + 1));
+   for (int y = 0; y <= depth; y++) {
+      for (int x = 0; x <= width; x++) {
+         float h;
+         is.read(reinterpret_cast<char*>(&h), sizeof(float));
+         pos[x + y*row] = make_vector(x - 0.5f, h, y - 0.5f);
+      }
+   }
+
+   vector<VectorF> normal(pos.size(), make_vector(0.0f, 1.0f, 0.0f));
+   for (int y = 1; y < depth; y++) {
+      for (int x = 1; x < width; x++) {
+         const int i = x + y*row;
+         normal[i] = surface_normal(pos[i + row], pos[i - 1], pos[i + 1]);
+      }
+   }
+
+   vector<InputList> sectors;
+
+   for (int sx = 0; sx < width; sx += SECTOR_SIZE) {
+      for (int sy = 0; sy < depth; sy += SECTOR_SIZE) {
+         InputList in;
+
+         const int xmax = min(sx + SECTOR_SIZE, width);
+         const int ymax = min(sy + SECTOR_SIZE, depth);
+         const float tmul = 1.0f / float(SECTOR_SIZE);
+
+         for (int x = xmax - 1; x >= sx; x--) {
+            for (int y = sy; y < ymax; y++) {
+               const int indexes[4] = {
+                  x + (y+1)*row, (x+1) + (y+1)*row,
+                  (x+1) + y*row, x + y*row
+               };
+
+               const int order[6] = {
+                  indexes[1], indexes[2], indexes[3],
+                  indexes[3], indexes[0], indexes[1]
+               };
+
+               const IMeshBuffer::TexCoord tex_coords[4] = {
+                  make_point(x * tmul, (y + 1) * tmul),
+                  make_point((x + 1) * tmul, (y + 1) * tmul),
+                  make_point((x + 1) * tmul, y * tmul),
+                  make_point(x * tmul, y * tmul)
+               };
+
+               const int tex_order[6] = { 1, 2, 3, 3, 0, 1 };
+
+               for (int i = 0; i < 6; i++) {
+                  Input input = {
+                     pos[order[i]], normal[order[i]],
+                     tex_coords[tex_order[i]]
+                  };
+                  in.push_back(input);
+               }
+            }
+         }
+
+         sectors.push_back(in);
+      }
+   }
+
+   return sectors;
+}
+
+// Just enough of the WaveFront format to get the face vertices
+static InputList model_inputs(const string& file_name)
+{
+   ifstream is(file_name.c_str());
+   if (!is.good())
+      throw runtime_error("Cannot open " + file_name);
+
+   vector<VectorF> vertices, normals;
+   vector<PointF> tex_coords;
+   InputList in;
+
+   string line;
+   while (getline(is, line)) {
+      istringstream ss(line);
+      string first;
+      ss >> first;
+
+      if (first == "v") {
+         float x, y, z;
+         ss >> x >> y >> z;
+         vertices.push_back(make_vector(x, y, z));
+      }
+      else if (first == "vn") {
+         float x, y, z;
+         ss >> x >> y >> z;
+         normals.push_back(make_vector(x, y, z));
+      }
+      else if (first == "vt") {
+         float x, y;
+         ss >> x >> y;
+         tex_coords.push_back(make_point(x, y));
+      }
+      else if (first == "f") {
+         string word;
+         while (ss >> word) {
+            unsigned vi = 0, vti = 0, vni = 0;
+            char d1, d2;
+            istringstream ws(word);
+            ws >> vi >> d1;
+            if (!(ws >> vti)) {
+               vti = 0;
+               ws.clear();
+            }
+            ws >> d2 >> vni;
+
+            Input input = {
+               vertices.at(vi - 1), normals.at(vni - 1),
+               vti > 0 ? tex_coords.at(vti - 1) : make_point(0.0f, 0.0f)
+            };
+            in.push_back(input);
+         }
+      }
+   }
+
+   return in;
+}
+
+template <class Buffer>
+static size_t fill(Buffer& buf, const InputList& in)
+{
+   for (auto& i : in)
+      buf.add(i.vertex, i.normal, colour::WHITE, i.tex_coord);
+
+   return buf.vertex_count();
+}
+
+static double seconds_since(clock_t start)
+{
+   return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void compare(const string& what, const vector<InputList>& meshes)
+{
+   size_t adds = 0, linear_verts = 0, hashed_verts = 0;
+
+   clock_t start = clock();
+   for (auto& in : meshes) {
+      LinearBuffer buf;
+      linear_verts += fill(buf, in);
+      adds += in.size();
+   }
+   const double linear_time = seconds_since(start);
+
+   start = clock();
+   for (auto& in : meshes) {
+      IMeshBufferPtr buf = make_mesh_buffer();
+      hashed_verts += fill(*buf, in);
+   }
+   const double hashed_time = seconds_since(start);
+
+   cout << what << ": " << meshes.size() << " buffers, "
+        << adds << " adds, " << hashed_verts << " vertices" << endl
+        << "   linear " << linear_time * 1000.0 << "ms"
+        << "   hashed " << hashed_time * 1000.0 << "ms";
+   if (hashed_time > 0.0)
+      cout << "   (" << linear_time / hashed_time << "x)";
+   cout << endl
+        << "   vertex data " << hashed_verts * UNPACKED_VERTEX_SIZE / 1024
+        << "KB unpacked, " << hashed_verts * PACKED_VERTEX_SIZE / 1024
+        << "KB packed" << endl;
+
+   assert(linear_verts == hashed_verts);
+}
+
+int main(int argc, char **argv)
+{
+   const string map_file = argc > 1 ? argv[1] : "maps/long_map/long_map.bin";
+
+   vector<InputList> sectors = terrain_inputs(map_file);
+   compare(map_file + " sectors", sectors);
+
+   // Build the whole map as one buffer to show the quadratic cost
+   InputList whole;
+   for (auto& s : sectors)
+      whole.insert(whole.end(), s.begin(), s.end());
+   compare(map_file + " whole", vector<InputList>(1, whole));
+
+   for (int i = 2; i < argc; i++)
+      compare(argv[i], vector<InputList>(1, model_inputs(argv[i])));
+
+   return 0;
+}